@@ -0,0 +1,265 @@
+#include "project.h"
+#include "drivers.h"
+#include "args.h"
+#include "json.h"
+#include "run.h"
+#include "util.h"
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+
+// measures RBuild's own overhead on generated projects, compiled by a stub compiler that only writes its outputs
+// usage: bench_overhead [-files=1000,10000,100000] [-depth=3] [-headers=100] [-includes=5] [-targets=1] [-num_jobs=auto] [-rbuild=RBuild] [-dir=bench_project] [-keep]
+// when copied as 'stubcc' it is the stub compiler/linker itself
+
+int num_jobs=0;
+
+using std::filesystem::path;
+
+template<typename F>
+static double time_seconds(F &&f){
+    auto start=std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+}
+
+static std::vector<std::string> expand_args_files(int argc,char ** argv){
+    std::vector<std::string> args;
+    for(int i=1;i<argc;i++){
+        if(argv[i][0]=='@'){
+            std::string arg;
+            bool quoted=false;
+            for(char c:Util::readfile(argv[i]+1)){
+                if(c=='"'){
+                    quoted=!quoted;
+                }else if(!quoted&&(c==' '||c=='\n'||c=='\r'||c=='\t')){
+                    if(!arg.empty())args.push_back(std::move(arg));
+                    arg.clear();
+                }else{
+                    arg+=c;
+                }
+            }
+            if(!arg.empty())args.push_back(std::move(arg));
+        }else{
+            args.push_back(argv[i]);
+        }
+    }
+    return args;
+}
+
+// writes the output, and for compiles the dependency file, following quoted includes through the -I folders
+static int stubcc(int argc,char ** argv) try {
+    std::vector<std::string> args(expand_args_files(argc,argv));
+    std::string out,src,dfile;
+    std::vector<path> include_dirs;
+    for(size_t i=0;i<args.size();i++){
+        if(args[i]=="-o"&&i+1<args.size()){
+            out=args[++i];
+        }else if(args[i]=="-c"&&i+1<args.size()){
+            src=args[++i];
+        }else if(args[i].starts_with("-MF")){
+            dfile=args[i].substr(3);
+        }else if(args[i].starts_with("-I")){
+            include_dirs.push_back(args[i].substr(2));
+        }
+    }
+    if(out.empty())return EXIT_FAILURE;
+    Util::writefile(out,"");
+    if(!dfile.empty()&&!src.empty()){
+        std::string deps=out+": "+src;
+        for(const std::string &line:Util::split(Util::readfile(src),'\n')){
+            if(!line.starts_with("#include \""))continue;
+            const std::string header=line.substr(10,line.find('"',10)-10);
+            for(const path &dir:Util::merge(std::vector<path>{path(src).parent_path()},include_dirs)){
+                if(std::filesystem::exists(dir/header)){
+                    deps+=" \\\n "+(dir/header).string();
+                    break;
+                }
+            }
+        }
+        Util::writefile(dfile,deps+"\n");
+    }
+    return EXIT_SUCCESS;
+} catch(std::exception &e) {
+    std::cerr<<"stubcc: "<<e.what()<<"\n";
+    return EXIT_FAILURE;
+}
+
+struct synth_options {
+    size_t files;
+    size_t depth;
+    size_t headers;
+    size_t includes;
+    size_t targets;
+};
+
+static constexpr size_t files_per_folder=100;
+
+// sources are spread over targets, then over folders 'depth' levels deep of 'files_per_folder' sources each
+static void generate(const path &dir,const path &self,const path &stub,const synth_options &o){
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir/"inc");
+    for(size_t i=0;i<o.headers;i++){
+        Util::writefile((dir/"inc"/("h"+std::to_string(i)+".h")).string(),"#pragma once\nint h"+std::to_string(i)+"(void);\n");
+    }
+    
+    std::filesystem::copy_file(self,dir/stub,std::filesystem::copy_options::overwrite_existing);
+    
+    const size_t files_per_target=(o.files+o.targets-1)/o.targets;
+    const size_t folders=(files_per_target+files_per_folder-1)/files_per_folder;
+    const size_t fanout=std::max<size_t>(2,std::ceil(std::pow(double(folders),1.0/std::max<size_t>(o.depth,1))));
+    
+    std::string targets_json;
+    for(size_t t=0,i=0;t<o.targets;t++){
+        const std::string target="t"+std::to_string(t);
+        for(size_t k=0;k<files_per_target&&i<o.files;k++,i++){
+            path folder=dir/"src"/target;
+            for(size_t level=0,n=k/files_per_folder;level<o.depth;level++,n/=fanout){
+                folder/="d"+std::to_string(n%fanout);
+            }
+            std::filesystem::create_directories(folder);
+            std::string data;
+            for(size_t j=0;j<o.includes&&j<o.headers;j++){
+                data+="#include \"h"+std::to_string((i*7+j*13)%o.headers)+".h\"\n";
+            }
+            data+="int f"+std::to_string(i)+"(void){return "+std::to_string(i)+";}\n";
+            Util::writefile((folder/("f"+std::to_string(i)+".c")).string(),data);
+        }
+        targets_json+="\""+target+"\":{\"sources\":[\"src/"+target+"\"],\"flags_c\":[\"-Iinc\"]},";
+    }
+    
+    Util::writefile((dir/"synth.json").string(),
+        "{\"working_folder\":\"build\",\"noarch\":true,\"project_binary\":\"synth\","
+        "\"compiler_binary_override_all\":\""+(dir/stub).generic_string()+"\","
+        "\"linker_binary_override_all\":\""+(dir/stub).generic_string()+"\","
+        "\"targets\":{"+targets_json+"}}");
+}
+
+static double run_rbuild(const std::string &rbuild,const std::vector<std::string> &args){
+    Util::redirect_data rd;
+    int result;
+    double seconds=time_seconds([&](){
+        result=Util::run(rbuild,Util::merge(std::vector<std::string>{"-file=synth.json","-ignore_warnings"},args),nullptr,true,&rd);
+    });
+    rd.stop();
+    if(result!=0){
+        throw std::runtime_error(Util::quote_str_single(rbuild)+" failed:\n"+rd.s_stdout+rd.s_stderr);
+    }
+    return seconds;
+}
+
+static void bench(const path &dir,const path &self,const path &stub,const std::string &rbuild,const synth_options &o){
+    const path old_cwd=std::filesystem::current_path();
+    
+    std::cout<<o.files<<" files\n";
+    std::cout<<"  generate            : "<<time_seconds([&](){generate(dir,self,stub,o);})<<" s\n";
+    
+    std::filesystem::current_path(dir);
+    
+    constexpr int parse_iterations=100;
+    std::optional<JSON::Element> project_json; // the project reads its targets from it, so it must outlive the project
+    std::optional<Project> project;
+    std::vector<std::string> warnings;
+    const double parse=time_seconds([&](){
+        for(int i=0;i<parse_iterations;i++){
+            project.reset();
+            project_json=JSON::parse(Util::readfile("synth.json"));
+            project.emplace(project_json->get_obj(),warnings);
+            project->load_targets(project->targets.names,warnings);
+        }
+    })/parse_iterations;
+    std::cout<<"  json parse          : "<<parse*1e6<<" us\n";
+    
+    std::vector<path> sources;
+    const double gather=time_seconds([&](){
+        for(const std::string &name:project->targets.names){
+            gather_sources(sources,std::filesystem::current_path(),project->targets.at(name).sources);
+        }
+    });
+    std::cout<<"  gather_sources      : "<<gather*1e3<<" ms ("<<sources.size()<<" sources)\n";
+    
+    const std::string jobs="-num_jobs="+std::to_string(num_jobs);
+    const double full=run_rbuild(rbuild,{jobs});
+    std::cout<<"  full build          : "<<full<<" s ("<<sources.size()/full<<" spawns/s)\n";
+    
+    // same as a no-job build, every stat up front then the checks, as if it was a fresh process
+    drivers::compiler::gnu driver((dir/stub).string(),{"-Iinc"},{});
+    const path src_base=std::filesystem::current_path();
+    const double checks=time_seconds([&](){
+        for(const std::string &name:project->targets.names){
+            std::vector<path> target_sources;
+            gather_sources(target_sources,src_base,project->targets.at(name).sources);
+            const path working_path=path("build")/name;
+            driver.prefetch(working_path,src_base,Util::map(target_sources,[&](const path &src){return std::pair<path,path>(src,driver.get_out(working_path,src_base,src));}));
+            for(const path &src:target_sources){
+                if(driver.needs_compile(working_path,src_base,src,driver.get_out(working_path,src_base,src))){
+                    throw std::runtime_error(Util::quote_str_single(src.string())+" is out of date after a full build");
+                }
+            }
+        }
+    });
+    std::cout<<"  needs_compile       : "<<checks*1e3<<" ms ("<<checks*1e6/sources.size()<<" us/source)\n";
+    
+    double noop=INFINITY;
+    for(int i=0;i<3;i++){
+        noop=std::min(noop,run_rbuild(rbuild,{jobs}));
+    }
+    std::cout<<"  no-op build         : "<<noop*1e3<<" ms (best of 3)\n\n";
+    
+    std::filesystem::current_path(old_cwd);
+}
+
+static path self_path([[maybe_unused]] char * argv0){ // only needed without /proc
+    #if defined(__linux__)
+        return std::filesystem::read_symlink("/proc/self/exe");
+    #else
+        return std::filesystem::absolute(argv0);
+    #endif
+}
+
+int main(int argc,char ** argv) try {
+    if(path(argv[0]).stem()=="stubcc"){
+        return stubcc(argc,argv);
+    }
+    
+    Args::init(argc,argv);
+    
+    drivers::compiler::include_check="-MD";
+    
+    std::optional<int> njopt=Args::namedIntArgOrMatchStr("num_jobs",0,"auto",false);
+    num_jobs=njopt?*njopt:Util::numCPUs();
+    
+    synth_options o{
+        .files=0,
+        .depth=size_t(Args::namedIntArgOr("depth",3,false)),
+        .headers=size_t(Args::namedIntArgOr("headers",100,false)),
+        .includes=size_t(Args::namedIntArgOr("includes",5,false)),
+        .targets=size_t(std::max(Args::namedIntArgOr("targets",1,false),1)),
+    };
+    
+    std::string rbuild=Util::find_executable(Args::namedArgOr("rbuild","RBuild"));
+    if(!std::filesystem::exists(rbuild)&&std::filesystem::exists("build/lin/release/bin/RBuild")){
+        rbuild="build/lin/release/bin/RBuild";
+    }
+    rbuild=std::filesystem::absolute(rbuild).string();
+    
+    const path dir=std::filesystem::absolute(Args::namedArgOr("dir","bench_project"));
+    
+    const path self=self_path(argv[0]);
+    const path stub="stubcc"+self.extension().string();
+    
+    std::cout<<"benchmarking "<<Util::quote_str_single(rbuild)<<" with "<<num_jobs<<" jobs\n\n";
+    
+    for(const std::string &files:Util::split(Args::namedArgOr("files","1000,10000,100000"),',')){
+        o.files=std::stoul(files);
+        bench(dir,self,stub,rbuild,o);
+        if(!Args::has_flag("keep"))std::filesystem::remove_all(dir);
+    }
+    return EXIT_SUCCESS;
+} catch(std::exception &e) {
+    std::cerr<<"Unexpected Exception: "<<e.what()<<"\n";
+    return EXIT_FAILURE;
+}
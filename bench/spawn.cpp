@@ -0,0 +1,36 @@
+#include "run.h"
+#include "util.h"
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+
+// measures how many processes Util::run can spawn per second
+// usage: bench_spawn [iterations] [program]
+
+static double spawns_per_second(const std::string &program,int iterations){
+    auto start=std::chrono::steady_clock::now();
+    for(int i=0;i<iterations;i++){
+        if(Util::run(program,{},nullptr,true)!=0){
+            throw std::runtime_error(Util::quote_str_single(program)+" returned non-zero");
+        }
+    }
+    std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-start;
+    return iterations/elapsed.count();
+}
+
+int main(int argc,char ** argv) try {
+    int iterations=argc>1?std::atoi(argv[1]):1000;
+    std::string program=argc>2?argv[2]:"true";
+    if(iterations<=0){
+        throw std::runtime_error("iteration count must be positive");
+    }
+    std::string resolved=Util::find_executable(program);
+    std::cout<<"spawning "<<Util::quote_str_single(program)<<" "<<iterations<<" times\n";
+    std::cout<<"PATH lookup per spawn : "<<spawns_per_second(program,iterations)<<" spawns/s\n";
+    std::cout<<"resolved once         : "<<spawns_per_second(resolved,iterations)<<" spawns/s ("<<resolved<<")\n";
+    return EXIT_SUCCESS;
+} catch(std::exception &e) {
+    std::cerr<<"Unexpected Exception: "<<e.what()<<"\n";
+    return EXIT_FAILURE;
+}
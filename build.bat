@@ -5,7 +5,7 @@ IF ERRORLEVEL 1 (
 
     ECHO building release...
 
-    g++ src/args.cpp src/json.cpp src/main.cpp src/project.cpp src/targets.cpp src/util.cpp src/drivers.cpp -Iinclude -Werror=return-type -Werror=suggest-override -std=c++20 -fexceptions -O2 -s -lrpcrt4 -o build/win/release/bin/RBuild
+    g++ src/args.cpp src/json.cpp src/main.cpp src/project.cpp src/targets.cpp src/util.cpp src/drivers.cpp src/deps.cpp src/remote.cpp src/tokens.cpp src/plan.cpp src/toolchain.cpp -Iinclude -Werror=return-type -Werror=suggest-override -std=c++20 -fexceptions -O2 -s -lrpcrt4 -o build/win/release/bin/RBuild
     IF ERRORLEVEL 1 (
         ECHO Release build failed
     ) ELSE (
@@ -0,0 +1,18 @@
+#include "remote.h"
+#include "args.h"
+#include "util.h"
+
+#include <iostream>
+#include <cstdlib>
+
+// reference server for RBuild's -cache, a Bazel compatible HTTP cache storing its entries as files, see README.md
+// usage: rbuild-cache [-listen=127.0.0.1:8080|unix:/path] [-dir=rbuild-cache]
+
+int main(int argc,char ** argv) try {
+    Args::init(argc,argv);
+    
+    Remote::serve_cache(Args::namedArgOr("listen","127.0.0.1:8080"),Args::namedArgOr("dir","rbuild-cache"));
+} catch(std::exception &e) {
+    std::cerr<<"Unexpected Exception: "<<e.what()<<"\n";
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+#include <unordered_map>
+#include <filesystem>
+#include <cstdint>
+
+// per-target index of the files each source depends on and how long it took to compile, rewritten after builds that compiled anything,
+// so that 'deps' queries don't have to parse every dependency file
+class DepsIndex {
+    std::unordered_map<std::string,uint32_t> file_ids;
+public:
+    struct source {
+        uint32_t file; // index into files
+        double compile_seconds; // negative if never timed
+        std::vector<uint32_t> deps; // indices into files
+    };
+    
+    std::vector<std::string> files;
+    std::vector<source> sources;
+    
+    uint32_t intern(const std::string &file);
+    void add_source(const std::string &file,double compile_seconds,const std::vector<std::string> &deps);
+    
+    std::unordered_map<std::string,double> get_compile_seconds() const; // timed sources by file
+    
+    static std::optional<DepsIndex> read(const std::filesystem::path &index_file); // nullopt if missing or unreadable
+    void write(const std::filesystem::path &index_file) const;
+};
+
+// per-target content hashes of the files it links, each with the write time and size it was taken at, so that only files that were written again get rehashed;
+// a recompiled object that hashes the same as before didn't change, and a link whose inputs all hash the same as last time is skipped
+class OutputHashes {
+public:
+    struct entry {
+        int64_t time;
+        uint64_t size;
+        std::string hash;
+    };
+    
+    std::unordered_map<std::string,entry> entries;
+    bool changed=false; // if any entry was added or updated since reading
+    
+    std::optional<std::string> get_recorded(const std::string &file) const; // the hash last taken, even if 'file' was written since
+    std::optional<std::string> hash(const std::string &file); // current hash of 'file', nullopt if it doesn't exist
+    
+    static OutputHashes read(const std::filesystem::path &index_file); // empty if missing or unreadable
+    void write(const std::filesystem::path &index_file) const;
+};
@@ -4,21 +4,63 @@
 #include <vector>
 #include <map>
 #include <filesystem>
+#include <mutex>
+#include <optional>
 #include "util.h"
 #include "run.h"
+#include "tokens.h"
+#include "toolchain.h"
 
 namespace drivers {
     
+    enum lto_mode {
+        LTO_OFF,
+        LTO_FULL,
+        LTO_THIN, // clang only, gcc falls back to LTO_FULL
+    };
+    
     namespace compiler {
         
         extern std::string include_check;
         extern bool filetime_nocache;
+        extern bool token_hash; // sources/dependencies newer than their object are only recompiled if their tokens changed since it was compiled
+        
+        int io_threads(); // threads for work bound by filesystem latency (stats, reading dependency files) rather than by CPU
+        
+        struct options {
+            bool split_dwarf=false; // gnu drivers, compile with -gsplit-dwarf, keeping the .dwo files next to the objects
+            lto_mode lto=LTO_OFF; // gnu drivers, compile to LTO objects
+            std::vector<std::string> dep_flags; // generic driver, flags that make the compiler write a dependency file, with '%d' replaced by its path, if empty sources are only checked against their objects
+            std::string dep_format="make"; // generic driver, format of the dependency file, 'make' (make rules) or 'list' (one dependency per line)
+        };
+        
+        struct explanation { // why needs_compile returns true
+            std::string reason; // empty if the file is up to date
+            std::vector<std::string> changed; // dependencies newer than the object, or gone
+        };
+        
+        struct module_deps { // C++20 named modules a source file exports and imports
+            std::vector<std::string> provides;
+            std::vector<std::string> imports;
+        };
         
         class driver {
         public:
             virtual ~driver()=0;
             virtual bool needs_compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out)=0;
             virtual bool compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd)=0;
+            virtual std::string get_signature()=0; // everything besides the source that affects the objects this driver produces
+            virtual const Toolchain::fingerprint& get_fingerprint()=0; // identity of the compiler binary
+            virtual explanation explain(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out); // needs_compile, but with the reason
+            virtual std::optional<std::vector<std::string>> get_dependencies(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in); // files the source's last compile depended on, if known
+            virtual std::vector<std::filesystem::path> get_outputs(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out); // every file compiling the source may leave behind, for deleting the outputs of removed sources
+            virtual void prefetch(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::vector<std::pair<std::filesystem::path,std::filesystem::path>> &files); // stat everything needs_compile will look at for 'files' (source, object pairs) at once, ahead of the needs_compile calls
+            
+            // C++20 modules, the scan result is cached in the tmp folder and only regenerated if 'rescan' is set or if the cached result is missing
+            virtual module_deps scan_modules(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,bool rescan,Util::redirect_data * rd);
+            virtual std::filesystem::path get_bmi(const std::filesystem::path &working_path,const std::string &module_name); // compiled module interface of 'module_name'
+            virtual void prepare_modules(const std::filesystem::path &working_path,const std::vector<std::string> &module_names); // called once before compiling, with every module provided by the target
+            virtual std::vector<std::string> module_flags(const std::filesystem::path &working_path,const module_deps &deps); // extra compile flags for a source file using modules
         };
         
         class base : public driver {
@@ -27,38 +69,73 @@ namespace drivers {
             std::vector<std::string> flags;
             std::vector<std::string> defines;
             std::vector<std::string> defines_calc;
+            std::vector<std::string> common_args;
+            std::once_flag common_args_once;
+            options opts;
             virtual void calc_defines();
+            const std::vector<std::string>& get_common_args(); // flags+defines, built once and shared by all compile jobs
         public:
-            base(const std::string &compiler,const std::vector<std::string> &flags,const std::vector<std::string> &defines);
+            base(const std::string &compiler,const std::vector<std::string> &flags,const std::vector<std::string> &defines,const options &opts={});
             virtual bool needs_compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out) override;
             virtual bool compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd) override;
+            virtual std::string get_signature() override;
+            virtual const Toolchain::fingerprint& get_fingerprint() override;
             
         };
         
+        // checks sources against their objects, and against the dependencies in the dependency file, if the compiler writes one
         class generic : public base {
+        protected:
+            virtual bool writes_dependency_file(); // if false only the source is checked against the object
+            virtual Tokens::syntax source_syntax(const std::filesystem::path &file_in);
+            void record_tokens(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in); // with token_hash, after a successful compile, the token hashes of the source and its dependencies
+            bool check(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,explanation * why);
         public:
             using base::base;
+            std::filesystem::path get_dpath(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &src_file);
+            std::filesystem::path get_out(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &src_file);
+            std::filesystem::path get_dwo(const std::filesystem::path &file_out);
+            std::filesystem::path get_tpath(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &src_file); // token hashes the object was compiled from
+            virtual bool needs_compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out) override;
+            virtual explanation explain(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out) override;
+            virtual std::optional<std::vector<std::string>> get_dependencies(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in) override;
+            virtual std::vector<std::filesystem::path> get_outputs(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out) override;
+            virtual void prefetch(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::vector<std::pair<std::filesystem::path,std::filesystem::path>> &files) override;
             virtual bool compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd) override;
         };
         
         class gas final : public generic {
         protected:
             virtual void calc_defines() override;
+            virtual bool writes_dependency_file() override;
+            virtual Tokens::syntax source_syntax(const std::filesystem::path &file_in) override;
         public:
             using generic::generic;
             virtual bool compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd) override;
         };
         
         class gnu : public generic {
+                bool llvm;
+                std::optional<bool> compile_remote(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,Util::redirect_data * rd); // preprocess locally and compile on a worker, nullopt if it can't be compiled remotely
+                bool cacheable(const std::filesystem::path &file_in); // if objects of 'file_in' can be taken from/stored in the remote cache
+                void start_cache_lookup(const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out); // the key covers the compiler, its version, the flags and the source, the headers are checked against the cached entry
+            protected:
+                virtual bool writes_dependency_file() override;
             public:
-                std::filesystem::path get_dpath(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &src_file);
-                std::filesystem::path get_out(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &src_file);
-                using generic::generic;
-                virtual bool needs_compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out) override;
+                std::filesystem::path get_ddi(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &src_file);
+                gnu(const std::string &compiler,const std::vector<std::string> &flags,const std::vector<std::string> &defines,const options &opts={},bool llvm=false);
+                virtual bool needs_compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out) override; // also starts the remote cache lookup of out of date sources
+                virtual std::vector<std::filesystem::path> get_outputs(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out) override;
                 virtual bool compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,const std::vector<std::string> &extra_args,Util::redirect_data * rd) override;
+                virtual module_deps scan_modules(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,bool rescan,Util::redirect_data * rd) override;
+                virtual std::filesystem::path get_bmi(const std::filesystem::path &working_path,const std::string &module_name) override;
+                virtual void prepare_modules(const std::filesystem::path &working_path,const std::vector<std::string> &module_names) override;
+                virtual std::vector<std::string> module_flags(const std::filesystem::path &working_path,const module_deps &deps) override;
         };
         
         class nasm final : public gnu {
+        protected:
+            virtual Tokens::syntax source_syntax(const std::filesystem::path &file_in) override;
         public:
             using gnu::gnu;
             virtual bool compile(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &file_in,const std::filesystem::path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd) override;
@@ -70,6 +147,17 @@ namespace drivers {
         
         extern bool force_static_link;
         
+        struct options {
+            bool ar_incremental=false; // only replace archive members whose objects changed since the last link
+            bool ar_thin=false; // create thin archives, that reference the objects instead of copying them
+            std::string backend; // linker used by the gnu drivers, passed as -fuse-ld, empty for the compiler's default
+            int threads=0; // number of threads the linker backend may use, 0 to leave it up to the linker
+            bool dwp=false; // gnu drivers, package the .dwo files of the linked objects into '[output].dwp' after linking
+            lto_mode lto=LTO_OFF; // gnu drivers, link with LTO, partitioned over 'threads' jobs, thin LTO is cached in tmp/thinlto
+        };
+        
+        std::string detect_backend(); // fastest installed backend out of mold, lld and gold, empty if none are found
+        
         class driver {
         public:
             virtual ~driver()=0;
@@ -77,6 +165,10 @@ namespace drivers {
             virtual void clear()=0;
             virtual bool link(const std::filesystem::path &working_path,const std::filesystem::path &file_out,const std::vector<std::string> &extra_flags)=0;
             virtual std::string get_ext()=0;
+            virtual std::string get_signature()=0; // everything besides the linked files that affects the output
+            virtual std::vector<std::filesystem::path> get_files()=0; // files to link, in link order
+            virtual std::vector<std::filesystem::path> get_lib_files()=0; // existing files the flags and libs link against, given by path or found through -l in the -L folders, system libraries aren't looked for
+            virtual const Toolchain::fingerprint& get_fingerprint()=0; // identity of the linker binary
         };
         
         class base : public driver {
@@ -84,14 +176,19 @@ namespace drivers {
             std::string linker;
             std::vector<std::string> flags;
             std::vector<std::string> libs;
+            options opts;
             std::map<ssize_t,std::vector<std::filesystem::path>> link_files;
             std::vector<std::string> join_link_files();
         public:
-            base(const std::string &linker,const std::vector<std::string> &flags,const std::vector<std::string> &libs);
+            base(const std::string &linker,const std::vector<std::string> &flags,const std::vector<std::string> &libs,const options &opts={});
             virtual void add_file(ssize_t link_order,const std::filesystem::path &file) override;
             virtual void clear() override;
             virtual bool link(const std::filesystem::path &working_path,const std::filesystem::path &file_out,const std::vector<std::string> &extra_flags) override;
             virtual std::string get_ext() override;
+            virtual std::string get_signature() override;
+            virtual std::vector<std::filesystem::path> get_files() override;
+            virtual std::vector<std::filesystem::path> get_lib_files() override;
+            virtual const Toolchain::fingerprint& get_fingerprint() override;
         };
         
         class generic : public base {
@@ -102,10 +199,12 @@ namespace drivers {
         
         class gnu final : public generic {
                 bool cpp=false;
+                bool llvm;
                 std::string linker_cpp;
             public:
-                gnu(const std::string &linker_c,const std::string &linker_cpp,const std::vector<std::string> &flags,const std::vector<std::string> &libs);
+                gnu(const std::string &linker_c,const std::string &linker_cpp,const std::vector<std::string> &flags,const std::vector<std::string> &libs,bool llvm,const options &opts={});
                 virtual void add_file(ssize_t link_order,const std::filesystem::path &file) override;
+                virtual bool link(const std::filesystem::path &working_path,const std::filesystem::path &file_out,const std::vector<std::string> &extra_flags) override;
         };
         
         class ar final : public base {
@@ -122,8 +221,8 @@ namespace drivers {
         LANG_ASM,
     };
     
-    std::unique_ptr<compiler::driver> get_compiler(const std::string &name,compiler_lang lang,const std::vector<std::string> &flags,const std::vector<std::string> &defines,const std::optional<std::string> &compiler_binary_override=std::nullopt);
+    std::unique_ptr<compiler::driver> get_compiler(const std::string &name,compiler_lang lang,const std::vector<std::string> &flags,const std::vector<std::string> &defines,const std::optional<std::string> &compiler_binary_override=std::nullopt,const compiler::options &opts={});
     
-    std::unique_ptr<linker::driver> get_linker(const std::string &name,const std::vector<std::string> &flags,const std::vector<std::string> &libs,const std::optional<std::string> &linker_binary_override_c=std::nullopt,const std::optional<std::string> &linker_binary_override_cpp=std::nullopt,const std::optional<std::string> &linker_binary_override_other=std::nullopt);
+    std::unique_ptr<linker::driver> get_linker(const std::string &name,const std::vector<std::string> &flags,const std::vector<std::string> &libs,const std::optional<std::string> &linker_binary_override_c=std::nullopt,const std::optional<std::string> &linker_binary_override_cpp=std::nullopt,const std::optional<std::string> &linker_binary_override_other=std::nullopt,const linker::options &opts={});
     
 }
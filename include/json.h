@@ -171,7 +171,7 @@ namespace JSON {
     inline Element Array(const std::vector<Element> & v){ return Element(Element::data_t(v)); }
     inline Element Array(std::vector<Element> && v){ return Element(Element::data_t(std::move(v))); }
     inline Element Object(const std::map<std::string,Element> & m){ return Element(Element::data_t(m)); }
-    inline Element Object(std::map<std::string,Element> && m){ return Element(Element::data_t(std::move(m))); }
+    inline Element Object(std::map<std::string,Element> && m){ Element e(JSON_NULL); e.data.emplace<object_t>(std::move(m)); return e; } // built in place, moving a temporary variant makes g++ -O2 warn about uninitialized members
     
     inline std::vector<std::string> mkstrlist(const array_t &arr) try {
         std::vector<std::string> strlist;
@@ -279,6 +279,13 @@ namespace JSON {
         throw JSON_Exception("In "+Util::quote_str_single(name)+": "+e.msg_top);
     }
     
+    inline std::optional<bool> bool_opt(const object_t &obj,const std::string &name) try {
+        auto it=obj.find(name);
+        return (it!=obj.end())?it->second.get_bool():std::optional<bool>{std::nullopt};
+    } catch(JSON_Exception &e){
+        throw JSON_Exception("In "+Util::quote_str_single(name)+": "+e.msg_top);
+    }
+    
     inline std::string str_nonopt(const object_t &obj,const std::string &name) try {
         return obj.at(name).get_str();
     } catch(JSON_Exception &e) {
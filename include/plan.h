@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <optional>
+#include <filesystem>
+#include <cstdint>
+#include "targets.h"
+
+// everything building a target needs from the project file and from walking its source folders, with drivers, flags and binaries already resolved
+struct TargetPlan {
+    struct compiler_t {
+        std::string driver;
+        std::vector<std::string> flags;
+        std::vector<std::string> defines;
+        std::optional<std::string> binary;
+    };
+    
+    compiler_t compiler_c;
+    compiler_t compiler_cpp;
+    compiler_t compiler_asm;
+    
+    std::string linker;
+    std::vector<std::string> linker_flags;
+    std::vector<std::string> linker_libs;
+    std::optional<std::string> linker_binary_c;
+    std::optional<std::string> linker_binary_cpp;
+    std::optional<std::string> linker_binary_other;
+    bool linker_ar_incremental;
+    bool linker_ar_thin;
+    std::string linker_backend;
+    std::vector<Targets::target::link_order_t> linker_order;
+    
+    bool split_dwarf;
+    bool split_dwarf_dwp;
+    std::string lto;
+    std::vector<std::string> generic_dep_flags;
+    std::string generic_dep_format;
+    bool cpp_modules;
+    
+    std::filesystem::path src_base;
+    std::filesystem::path working_path;
+    std::filesystem::path binary_folder;
+    std::string binary_name;
+    std::optional<std::string> binary_ext; // the linker's if not set
+    
+    std::vector<std::filesystem::path> sources;
+    std::vector<std::pair<std::filesystem::path,int64_t>> folders; // every folder listed while gathering the sources, with its write time
+    
+    bool sources_up_to_date() const; // if none of the folders changed, so no source was added or removed since the plan was made
+};
+
+// plans of the targets built from the same project file, kept in the working folder between runs so that unchanged projects skip resolving targets and walking source folders
+class PlanCache {
+public:
+    std::string key; // what the plans were made from, the project file's contents and the working directory
+    std::map<std::string,TargetPlan> plans;
+    bool changed=false; // if any plan was added or replaced since reading
+    
+    static PlanCache read(const std::filesystem::path &cache_file,const std::string &key); // empty if missing, unreadable or made for another key
+    void write(const std::filesystem::path &cache_file) const;
+};
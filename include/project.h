@@ -1,12 +1,21 @@
 #pragma once
 
+#include <filesystem>
 #include "json.h"
 #include "targets.h"
+#include "plan.h"
 
 extern int num_jobs;
 
+void gather_sources(std::vector<std::filesystem::path> & out,const std::filesystem::path &root,const std::vector<Targets::target::source_t> &folders,std::vector<std::pair<std::filesystem::path,int64_t>> * listed_folders=nullptr); // every file 'folders' selects under 'root', and every folder whose write time says whether that changed
+
 class Project {
     std::vector<std::string> resolve_target_groups(const std::vector<std::string> &);
+    PlanCache plan_cache;
+    bool plan_cache_read=false;
+    TargetPlan make_plan(const std::string &);
+    const TargetPlan& get_plan(const std::string &); // from plan.cache if it's still valid
+    void save_plans();
 public:
     Targets targets;
     std::vector<std::string> default_targets;
@@ -38,11 +47,18 @@ public:
     std::optional<std::string> linker_binary_override_all;
     
     bool noarch;
+    bool shared_objects;
+    
+    std::string plan_key; // identifies the project file, plans are only cached in '[working_folder]/plan.cache' if set
+    
+    Project(const JSON::object_t &project,std::vector<std::string> &warnings_out); // 'project' must outlive this, see Targets
     
-    Project(const JSON::object_t &project,std::vector<std::string> &warnings_out);
+    void load_targets(const std::vector<std::string> &,std::vector<std::string> &warnings_out); // constructs the given targets and target groups, and whatever they include, before they're built, cleaned or shown
     
     bool build_targets(const std::vector<std::string> &,bool failexit);
     bool build_target(const std::string &);
     bool clean_targets(const std::vector<std::string> &,bool failexit);
     void clean_target(const std::string &);
+    bool show_deps(const std::vector<std::string> &,bool failexit);
+    void show_target_deps(const std::string &);
 };
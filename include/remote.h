@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <optional>
+
+// running compiles on rbuild-worker processes, over TCP ('host:port') or unix sockets ('unix:/path'), and sharing objects through a remote cache
+namespace Remote {
+    
+    struct file {
+        std::string name; // relative to the worker's scratch folder
+        std::string data;
+    };
+    
+    struct request {
+        std::string program;
+        std::vector<std::string> args; // '%w' is replaced by the worker's scratch folder
+        std::vector<file> inputs; // written to the scratch folder before running 'program'
+        std::vector<std::string> outputs; // read back from the scratch folder after running 'program'
+    };
+    
+    struct response {
+        int status;
+        std::string s_stdout;
+        std::string s_stderr;
+        std::vector<std::optional<std::string>> outputs; // same order as request::outputs, nullopt if the file wasn't written
+    };
+    
+    void set_workers(const std::vector<std::string> &endpoints);
+    bool enabled(); // if any workers were set
+    
+    std::optional<response> execute(const request &req); // runs 'req' on the next worker that accepts it, nullopt if none could be reached or run it
+    
+    [[noreturn]] void serve(const std::string &endpoint,int max_jobs,const std::vector<std::string> &allowed_programs); // worker side, runs requests from clients, at most 'max_jobs' at once, only for programs whose file name or path is in 'allowed_programs'
+    
+    // remote build cache, over the HTTP protocol of Bazel's remote cache: GET/PUT '[url]/ac/[key]' for action results, and '[url]/cas/[sha256]' for the files they refer to
+    void set_cache(const std::string &url); // 'http://host:port[/prefix]'
+    bool cache_enabled(); // if a cache was set, and hasn't failed
+    
+    std::optional<std::string> cache_get(const std::string &kind,const std::string &key); // 'kind' is 'ac' or 'cas', nullopt if missing or if the cache failed
+    void cache_put(const std::string &kind,const std::string &key,const std::string &data);
+    
+    [[noreturn]] void serve_cache(const std::string &endpoint,const std::string &folder); // reference cache server, storing entries as files in 'folder'
+
+}
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vector>
+#include <string>
+#include <filesystem>
 #include <atomic>
 #include <thread>
 
@@ -46,17 +48,22 @@ namespace Util {
         #endif
     };
     
-    int run_noexcept(const std::string &program,const std::vector<std::string> &args_in,std::string (*alternate_cmdline)(const std::string&,const std::vector<std::string>&)=nullptr,bool silent=false,redirect_data * redir_data=nullptr) noexcept;
+    std::string find_executable(const std::string &program); // resolve 'program' through PATH, returns 'program' unchanged if it already is a path or isn't found
     
-    int run(std::string program,const std::vector<std::string> &args_in,std::string (*alternate_cmdline)(const std::string&,const std::vector<std::string>&)=nullptr,bool silent=false,redirect_data * redir_data=nullptr);
+    // returns the arguments that make a program read the rest of its arguments from 'file'
+    using alternate_cmdline_t=std::vector<std::string>(*)(const std::string &file);
     
-    std::string alternate_cmdline_args_to_file(const std::string&,const std::vector<std::string>&,const std::string &file_arg);
-    inline std::string alternate_cmdline_args_to_file_regular(const std::string&p,const std::vector<std::string>&v){
-        return alternate_cmdline_args_to_file(p,v," @");
+    int run_noexcept(const std::string &program,const std::vector<std::string> &args_in,alternate_cmdline_t alternate_cmdline=nullptr,bool silent=false,redirect_data * redir_data=nullptr,const std::filesystem::path &args_file_folder={}) noexcept;
+    
+    // if the command line gets too long and 'alternate_cmdline' is set, the arguments are passed through a file in 'args_file_folder', unique to this call and removed after the program exits
+    int run(std::string program,const std::vector<std::string> &args_in,alternate_cmdline_t alternate_cmdline=nullptr,bool silent=false,redirect_data * redir_data=nullptr,const std::filesystem::path &args_file_folder={});
+    
+    inline std::vector<std::string> alternate_cmdline_args_to_file_regular(const std::string &file){
+        return {"@"+file};
     }
     
-    inline std::string alternate_cmdline_args_to_file_nasm(const std::string&p,const std::vector<std::string>&v){
-        return alternate_cmdline_args_to_file(p,v," -@ ");
+    inline std::vector<std::string> alternate_cmdline_args_to_file_nasm(const std::string &file){
+        return {"-@",file};
     }
     
 }
@@ -7,7 +7,6 @@
 #include "json.h"
 
 class Targets {
-    void process_includes(std::vector<std::string> &warnings_out);
 public:
     struct target {
         
@@ -86,13 +85,36 @@ public:
         std::optional<std::string> linker_binary_override_other;
         std::optional<std::string> linker_binary_override_all;
         
+        std::optional<bool> linker_ar_incremental;
+        std::optional<bool> linker_ar_thin;
+        std::optional<std::string> linker_backend;
+        
+        std::optional<bool> split_dwarf;
+        std::optional<bool> split_dwarf_dwp;
+        
+        std::optional<std::string> lto;
+        
+        std::vector<std::string> generic_dep_flags;
+        std::optional<std::string> generic_dep_format;
+        
+        std::optional<bool> cpp_modules;
+        
         bool include_only;
         
     };
     
-    std::map<std::string,target> targets;
+    std::vector<std::string> names; // targets that can be built, without groups and 'include_only' targets
     std::map<std::string,std::vector<std::string>> target_groups;
     
-    Targets(const JSON::object_t &targets,std::vector<std::string> &warnings_out);
+    Targets(const JSON::object_t &targets,std::vector<std::string> &warnings_out); // 'targets' must outlive this, targets are only read from it when loaded
+    
+    bool contains(const std::string &name) const;
+    void load(const std::vector<std::string> &target_names,std::vector<std::string> &warnings_out); // constructs 'target_names' and the targets they include, in a single pass over the include graph, targets whose includes fail are removed from 'names'
+    const target& at(const std::string &name) const; // throws std::runtime_error with the failed include if 'name' failed to load, std::out_of_range if it isn't a loaded target that can be built
     
+private:
+    std::map<std::string,const JSON::object_t*> definitions; // every target in the project file, constructed only when loaded
+    std::map<std::string,target> loaded; // targets constructed so far, with their includes merged
+    std::map<std::string,std::string> failed; // targets whose includes are unknown or recursive, with the include that failed
+    const target * load_target(const std::string &name,std::vector<std::string> &loading,std::vector<std::string> &failed_out,std::vector<std::string> &warnings_out);
 };
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <filesystem>
+
+// sources with comments and whitespace stripped, so that edits which can't change an object (comments, indentation) can be told apart from ones that can
+namespace Tokens {
+    
+    enum syntax {
+        SYNTAX_C, // C/C++ sources and headers, '//' and '/* */' comments, string, character and raw string literals are kept as is
+        SYNTAX_GAS, // GNU as, '/* */' comments only, '#' may be a preprocessor directive and ';' separates statements
+        SYNTAX_NASM, // ';' comments
+        SYNTAX_RAW, // anything else, nothing is stripped
+    };
+    
+    syntax syntax_of(const std::filesystem::path &file); // by extension, SYNTAX_NASM is never guessed, '.asm' may just as well be GNU as
+    
+    std::string normalize(std::string_view data,syntax syn); // 'data' without comments, and with every run of whitespace as a single space, or a single newline if it had any, so preprocessor lines stay apart
+    std::string hash(const std::string &file,syntax syn); // sha256 of the normalized contents of 'file', throws if it can't be read
+
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <filesystem>
+#include <cstdint>
+
+// identity of the compiler/linker binaries, kept between runs so that a binary is only asked for its version again once it changed on disk
+namespace Toolchain {
+    
+    struct fingerprint {
+        std::string path; // as resolved through PATH
+        std::string realpath; // with symlinks resolved, empty if the binary wasn't found
+        int64_t write_time=0; // of 'realpath'
+        uint64_t size=0; // of 'realpath'
+        std::string version; // '--version' output
+        
+        std::string id() const; // sha256 of everything but 'path', changes whenever the binary does
+    };
+    
+    extern std::filesystem::path cache_file; // where fingerprints are kept between runs, if empty they are only kept in memory
+    
+    const fingerprint& get(const std::string &binary); // thread-safe, binaries are checked outside the lock, a cached fingerprint is reused if its realpath, write time and size still match, '--version' only runs for new or changed binaries
+    void save(); // writes 'cache_file' if any fingerprint was added or changed
+    
+}
@@ -4,7 +4,9 @@
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <functional>
 #include <filesystem>
+#include <optional>
 
 #define __PP_JOIN(a,b) a##b
 #define PP_JOIN(a,b) __PP_JOIN(a,b)
@@ -37,8 +39,10 @@ namespace Util {
     
     int numCPUs();
     
-    std::string readfile(const std::string &filename);
-    void writefile(const std::string &filename,const std::string &data);
+    std::string readfile(const std::string &filename,bool binary=false);
+    void writefile(const std::string &filename,const std::string &data,bool binary=false);
+    
+    std::string sha256(const std::string &data); // lowercase hex digest
     
     std::string quote_str(const std::string &s,char quote_char);
     
@@ -74,6 +78,25 @@ namespace Util {
         return std::filesystem::canonical(sub).string().starts_with(std::filesystem::canonical(base).string());
     }
     
+    // 'sub' relative to 'base' if it is inside it, lexically when possible, as canonicalizing stats every component of both paths
+    inline std::optional<std::filesystem::path> subpath_relative(const std::filesystem::path &base,const std::filesystem::path &sub){
+        std::filesystem::path rel=sub.lexically_normal().lexically_relative(base.lexically_normal()); // sources of a '.' folder look like 'src/./file.c'
+        if(!rel.empty()&&*rel.begin()!=".."&&*rel.begin()!="."){
+            return rel;
+        }else if(is_subpath(base,sub)){
+            return std::filesystem::relative(sub,base);
+        }else{
+            return std::nullopt;
+        }
+    }
+    
+    const std::filesystem::path& project_root(); // the folder RBuild runs in, which the project's paths are relative to
+    
+    // 'file' relative to the project root if it's inside it, so that the paths RBuild records and passes to compilers don't depend on where the project is checked out
+    std::filesystem::path project_relative(const std::filesystem::path &file);
+    
+    std::string relativize_paths(std::string text); // project_relative, applied to every absolute path inside the project root in 'text' that starts a word or follows a short option (-I/path)
+    
     std::string join(const std::vector<std::string> &v,const std::string &on=" ");
     
     std::string join_or(const std::vector<std::string> &v,const std::string &sep_comma=", ",const std::string &sep_or=", or ");
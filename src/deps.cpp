@@ -0,0 +1,150 @@
+#include "deps.h"
+#include "util.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+static const char * deps_index_header="RBuild deps index 1\n";
+
+uint32_t DepsIndex::intern(const std::string &file){
+    auto [it,inserted]=file_ids.try_emplace(file,uint32_t(files.size()));
+    if(inserted)files.push_back(file);
+    return it->second;
+}
+
+void DepsIndex::add_source(const std::string &file,double compile_seconds,const std::vector<std::string> &deps){
+    const std::string rel_file=Util::project_relative(file).string();
+    source src{intern(rel_file),compile_seconds,{}};
+    for(const std::string &dep:deps){
+        const std::string rel_dep=Util::project_relative(dep).string();
+        if(rel_dep!=rel_file)src.deps.push_back(intern(rel_dep));// dependency files list the source itself too
+    }
+    sources.push_back(std::move(src));
+}
+
+std::unordered_map<std::string,double> DepsIndex::get_compile_seconds() const {
+    std::unordered_map<std::string,double> out;
+    for(const source &src:sources){
+        if(src.compile_seconds>=0)out.insert({files[src.file],src.compile_seconds});
+    }
+    return out;
+}
+
+std::optional<DepsIndex> DepsIndex::read(const std::filesystem::path &index_file) try {
+    if(!std::filesystem::exists(index_file))return std::nullopt;
+    const std::string data=Util::readfile(index_file.string());
+    if(!data.starts_with(deps_index_header))return std::nullopt;
+    
+    const char * p=data.c_str()+strlen(deps_index_header);
+    const char * const end=data.c_str()+data.size();
+    auto next_uint=[&p,end](){
+        if(p>=end)throw std::runtime_error("truncated");
+        char * next;
+        unsigned long n=strtoul(p,&next,10);
+        if(next==p)throw std::runtime_error("malformed");
+        p=next;
+        return n;
+    };
+    
+    DepsIndex index;
+    index.files.resize(next_uint());
+    p++;
+    for(std::string &file:index.files){
+        const char * nl=static_cast<const char*>(memchr(p,'\n',end-p));
+        if(!nl)throw std::runtime_error("truncated");
+        file.assign(p,nl);
+        index.file_ids.insert({file,uint32_t(&file-index.files.data())});
+        p=nl+1;
+    }
+    index.sources.resize(next_uint());
+    for(source &src:index.sources){
+        src.file=next_uint();
+        char * next;
+        src.compile_seconds=strtod(p,&next);
+        p=next;
+        src.deps.resize(next_uint());
+        for(uint32_t &dep:src.deps){
+            dep=next_uint();
+            if(dep>=index.files.size())throw std::runtime_error("malformed");
+        }
+        if(src.file>=index.files.size())throw std::runtime_error("malformed");
+    }
+    return index;
+}catch(std::exception &e){
+    return std::nullopt;
+}
+
+void DepsIndex::write(const std::filesystem::path &index_file) const {
+    std::string data(deps_index_header);
+    data+=std::to_string(files.size())+"\n";
+    for(const std::string &file:files){
+        data+=file+"\n";
+    }
+    data+=std::to_string(sources.size())+"\n";
+    char seconds[32];
+    for(const source &src:sources){
+        snprintf(seconds,sizeof(seconds),"%.3f",src.compile_seconds);
+        data+=std::to_string(src.file)+" "+seconds+" "+std::to_string(src.deps.size());
+        for(uint32_t dep:src.deps){
+            data+=" "+std::to_string(dep);
+        }
+        data+="\n";
+    }
+    std::filesystem::create_directories(std::filesystem::path(index_file).remove_filename());
+    Util::writefile(index_file.string(),data);
+}
+
+static const char * output_hashes_header="RBuild output hashes 1\n";
+
+std::optional<std::string> OutputHashes::get_recorded(const std::string &file) const {
+    if(auto it=entries.find(file);it!=entries.end())return it->second.hash;
+    return std::nullopt;
+}
+
+std::optional<std::string> OutputHashes::hash(const std::string &file){
+    std::error_code ec;
+    const auto time=std::filesystem::last_write_time(file,ec);
+    if(ec)return std::nullopt;
+    const uint64_t size=std::filesystem::file_size(file,ec);
+    if(ec)return std::nullopt;
+    const int64_t t=time.time_since_epoch().count();
+    auto it=entries.find(file);
+    if(it!=entries.end()&&it->second.time==t&&it->second.size==size)return it->second.hash;
+    std::string hash=Util::sha256(Util::readfile(file,true));
+    entries[file]={t,size,hash};
+    changed=true;
+    return hash;
+}
+
+OutputHashes OutputHashes::read(const std::filesystem::path &index_file) try {
+    OutputHashes hashes;
+    if(!std::filesystem::exists(index_file))return hashes;
+    const std::string data=Util::readfile(index_file.string());
+    if(!data.starts_with(output_hashes_header))return hashes;
+    // one '[time] [size] [hash] [file]' line per entry
+    for(const std::string &line:Util::split(data.substr(strlen(output_hashes_header)),'\n')){
+        char * next;
+        entry e;
+        e.time=strtoll(line.c_str(),&next,10);
+        e.size=strtoull(next,&next,10);
+        const char * p=next;
+        while(*p==' ')p++;
+        const char * space=strchr(p,' ');
+        if(!space||space==p)return OutputHashes{};
+        e.hash.assign(p,space);
+        hashes.entries.insert({std::string(space+1),std::move(e)});
+    }
+    return hashes;
+}catch(std::exception &e){
+    return OutputHashes{};
+}
+
+void OutputHashes::write(const std::filesystem::path &index_file) const {
+    std::string data(output_hashes_header);
+    for(const auto &[file,e]:entries){
+        data+=std::to_string(e.time)+" "+std::to_string(e.size)+" "+e.hash+" "+file+"\n";
+    }
+    std::filesystem::create_directories(std::filesystem::path(index_file).remove_filename());
+    Util::writefile(index_file.string(),data);
+}
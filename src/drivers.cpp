@@ -1,8 +1,24 @@
 #include "drivers.h"
 #include "util.h"
 #include "args.h"
+#include "json.h"
+#include "remote.h"
 
 #include <iostream>
+#include <fstream>
+#include <typeinfo>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <limits>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <future>
+#include <functional>
+#include <condition_variable>
 
 using std::filesystem::path;
 
@@ -11,12 +27,227 @@ namespace drivers {
         
         std::string include_check;
         bool filetime_nocache;
+        bool token_hash;
+        
+        int io_threads(){
+            // network filesystems especially, latency rather than CPU bound, so use more threads than compile jobs
+            static const int threads=std::max(8,Util::numCPUs()*2);
+            return threads;
+        }
+        
+        namespace {
+            // file write times, shared by all targets and safe to use from any thread, sharded by path hash to keep lock contention low;
+            // paths are interned, hashed and stored once, afterwards they're referred to by entry (dependency lists hold entries, not paths)
+            class filetime_cache_t {
+            public:
+                using rep=std::filesystem::file_time_type::rep;
+                static constexpr rep UNKNOWN=std::numeric_limits<rep>::min();
+                static constexpr rep MISSING=UNKNOWN+1;
+                
+                struct entry {
+                    const std::string * name=nullptr;
+                    std::atomic<rep> time=UNKNOWN;
+                    
+                    std::optional<std::filesystem::file_time_type> get(){ // nullopt for missing files
+                        rep t=time.load(std::memory_order_relaxed);
+                        if(t==UNKNOWN||filetime_nocache){
+                            std::error_code ec;
+                            auto ft=std::filesystem::last_write_time(*name,ec);
+                            t=ec?MISSING:ft.time_since_epoch().count();
+                            time.store(t,std::memory_order_relaxed);
+                        }
+                        if(t==MISSING)return std::nullopt;
+                        return std::filesystem::file_time_type(std::filesystem::file_time_type::duration(t));
+                    }
+                };
+                
+                entry * intern(const std::string &file){
+                    shard &s=shards[std::hash<std::string>{}(file)%num_shards];
+                    std::lock_guard<std::mutex> lock(s.mutex);
+                    auto [it,inserted]=s.entries.try_emplace(file);
+                    if(inserted)it->second.name=&it->first;
+                    return &it->second;
+                }
+                
+            private:
+                static constexpr size_t num_shards=64;
+                struct shard {
+                    std::mutex mutex;
+                    std::unordered_map<std::string,entry> entries;
+                };
+                shard shards[num_shards];
+            };
+            
+            filetime_cache_t filetime_cache;
+            
+            std::mutex dfile_cache_mutex;
+            std::unordered_map<filetime_cache_t::entry*,std::shared_ptr<const std::vector<filetime_cache_t::entry*>>> dfile_cache; // by dependency file
+            
+            // forget what's known about a file RBuild just wrote, so that later targets (shared objects) see its new time/contents
+            void invalidate_file(const path &file){
+                filetime_cache_t::entry * e=filetime_cache.intern(file.string());
+                e->time=filetime_cache_t::UNKNOWN;
+                std::lock_guard<std::mutex> lock(dfile_cache_mutex);
+                dfile_cache.erase(e);
+            }
+            
+            // headers found through absolute include paths have the project's location in them, stripped so that dependency files stay valid wherever the project is checked out
+            void relativize_dfile(const path &dfile){
+                std::error_code ec;
+                if(!std::filesystem::is_regular_file(dfile,ec))return;
+                std::string data=Util::readfile(dfile.string());
+                std::string rel=Util::relativize_paths(data);
+                if(rel!=data)Util::writefile(dfile.string(),rel);
+            }
+            
+            // token hashes by syntax and file, with the write time they were taken at, so that a header is lexed once per build, not once per source including it
+            std::mutex token_hash_mutex;
+            std::unordered_map<std::string,std::pair<filetime_cache_t::rep,std::string>> token_hash_cache;
+            
+            std::optional<std::string> get_token_hash(const std::string &file,Tokens::syntax syn){
+                filetime_cache_t::entry * e=filetime_cache.intern(file);
+                if(!e->get())return std::nullopt;
+                const filetime_cache_t::rep time=e->time.load(std::memory_order_relaxed);
+                const std::string key=std::to_string(syn)+":"+file;
+                {
+                    std::lock_guard<std::mutex> lock(token_hash_mutex);
+                    if(auto it=token_hash_cache.find(key);it!=token_hash_cache.end()&&it->second.first==time)return it->second.second;
+                }
+                std::string hash=Tokens::hash(file,syn);
+                std::lock_guard<std::mutex> lock(token_hash_mutex);
+                token_hash_cache[key]={time,hash};
+                return hash;
+            }
+            
+            const char * token_hashes_header="RBuild token hashes 1\n";
+            
+            // '[hash] [file]' lines, written after the object, so a token file older than its object is from an earlier compile
+            std::optional<std::unordered_map<std::string,std::string>> read_token_hashes(const path &tpath,std::filesystem::file_time_type object_time){
+                std::error_code ec;
+                auto time=std::filesystem::last_write_time(tpath,ec);
+                if(ec||time<object_time)return std::nullopt;
+                const std::string data=Util::readfile(tpath.string());
+                if(!data.starts_with(token_hashes_header))return std::nullopt;
+                std::unordered_map<std::string,std::string> hashes;
+                for(const std::string &line:Util::split(data.substr(strlen(token_hashes_header)),'\n')){
+                    size_t space=line.find(' ');
+                    if(space==std::string::npos)return std::nullopt;
+                    hashes.insert({line.substr(space+1),line.substr(0,space)});
+                }
+                return hashes;
+            }
+            
+            // remote cache lookups run on their own threads, started as soon as needs_compile finds a source out of date,
+            // so that they overlap with the remaining checks and with the compiles ahead of them in the queue;
+            // never destroyed, lookups may still be running when RBuild exits after a failed build
+            class remote_cache_t {
+            public:
+                struct entry {
+                    std::string key; // empty if the source couldn't be hashed
+                    std::optional<std::string> object; // set on a hit
+                    std::vector<std::string> deps; // what the cached object was compiled from, for its dependency file
+                };
+                
+                // contents hash of a file the cached objects depend on, nullopt if it's missing
+                std::optional<std::string> content_hash(const std::string &file){
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if(auto it=hashes.find(file);it!=hashes.end())return it->second;
+                    }
+                    std::optional<std::string> hash;
+                    if(std::filesystem::is_regular_file(file))hash=Util::sha256(Util::readfile(file,true));
+                    std::lock_guard<std::mutex> lock(mutex);
+                    hashes.insert({file,hash});
+                    return hash;
+                }
+                
+                void start_lookup(const std::string &file_out,std::function<entry()> lookup){
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(lookups.contains(file_out))return;
+                    auto task=std::make_shared<std::packaged_task<entry()>>(std::move(lookup));
+                    lookups.insert({file_out,task->get_future().share()});
+                    queue.push_back([task](){(*task)();});
+                    if(threads<io_threads()){
+                        threads++;
+                        std::thread(&remote_cache_t::work,this).detach();
+                    }
+                    cv.notify_one();
+                }
+                
+                std::optional<entry> take_lookup(const std::string &file_out){
+                    std::shared_future<entry> lookup;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        auto it=lookups.find(file_out);
+                        if(it==lookups.end())return std::nullopt;
+                        lookup=std::move(it->second);
+                        lookups.erase(it);
+                    }
+                    return lookup.get();
+                }
+            
+            private:
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::deque<std::function<void()>> queue;
+                int threads=0;
+                std::unordered_map<std::string,std::shared_future<entry>> lookups; // by object file
+                std::unordered_map<std::string,std::optional<std::string>> hashes;
+                
+                void work(){
+                    while(true){
+                        std::function<void()> job;
+                        {
+                            std::unique_lock<std::mutex> lock(mutex);
+                            cv.wait(lock,[this](){return !queue.empty();});
+                            job=std::move(queue.front());
+                            queue.pop_front();
+                        }
+                        job();
+                    }
+                }
+            };
+            
+            remote_cache_t &remote_cache=*new remote_cache_t;
+        }
         
         driver::~driver(){
             
         }
         
-        base::base(const std::string &cmp,const std::vector<std::string> &fs,const std::vector<std::string> &ds):compiler(cmp),flags(fs),defines(ds){
+        module_deps driver::scan_modules(const path &,const path &,const path &file_in,const path &,bool,Util::redirect_data *){
+            throw std::runtime_error("cannot scan "+Util::quote_str_single(std::filesystem::relative(file_in).string())+" for modules, C++ modules are only supported by the gcc and clang drivers");
+        }
+        
+        path driver::get_bmi(const path &working_path,const std::string &module_name){
+            return working_path/"tmp"/"bmi"/module_name;
+        }
+        
+        void driver::prepare_modules(const path &,const std::vector<std::string> &){
+            
+        }
+        
+        std::vector<std::string> driver::module_flags(const path &,const module_deps &){
+            return {};
+        }
+        
+        void driver::prefetch(const path &,const path &,const std::vector<std::pair<path,path>> &){
+            
+        }
+        
+        explanation driver::explain(const path &working_path,const path &src_base,const path &file_in,const path &file_out){
+            return {needs_compile(working_path,src_base,file_in,file_out)?"always compiled, this compiler driver doesn't support incremental builds":"",{}};
+        }
+        
+        std::optional<std::vector<std::string>> driver::get_dependencies(const path &,const path &,const path &){
+            return std::nullopt;
+        }
+        
+        std::vector<path> driver::get_outputs(const path &,const path &,const path &,const path &file_out){
+            return {file_out};
+        }
+        
+        base::base(const std::string &cmp,const std::vector<std::string> &fs,const std::vector<std::string> &ds,const options &o):compiler(Util::find_executable(cmp)),flags(fs),defines(ds),opts(o){
             
         }
         
@@ -24,87 +255,613 @@ namespace drivers {
             if(defines.size()>0&&defines_calc.size()==0)defines_calc=Util::map(defines,[](const std::string&s){return "-D"+s;});
         }
         
+        const std::vector<std::string>& base::get_common_args(){
+            std::call_once(common_args_once,[this](){
+                calc_defines();
+                common_args=Util::merge(flags,defines_calc);
+            });
+            return common_args;
+        }
+        
+        std::string base::get_signature(){
+            return Util::join(Util::merge(std::vector<std::string>{typeid(*this).name(),compiler,include_check,std::to_string(opts.split_dwarf),std::to_string(opts.lto)},get_common_args()),"\n");
+        }
+        
+        const Toolchain::fingerprint& base::get_fingerprint(){
+            return Toolchain::get(compiler);
+        }
+        
         bool base::needs_compile(const path &,const path &,const path &,const path &){
             return true;
         }
         
         bool base::compile(const path &working_path,const path &src_base,const path &file_in,const path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd){
-            calc_defines();
             static bool silent=!Args::has_flag("verbose");
             std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
             if(silent) Util::print_sync(std::filesystem::relative(file_in).string()+"\n");
-            return Util::run(compiler,Util::merge(std::vector<std::string>{file_in.string(),"-o",file_out.string()},flags,defines_calc,extra_flags),nullptr,silent,rd)==0;
+            const bool ok=Util::run(compiler,Util::merge(std::vector<std::string>{Util::project_relative(file_in).string(),"-o",file_out.string()},get_common_args(),extra_flags),nullptr,silent,rd)==0;
+            invalidate_file(file_out);
+            return ok;
         }
         
         bool generic::compile(const path &working_path,const path &src_base,const path &file_in,const path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd){
-            calc_defines();
             static bool silent=!Args::has_flag("verbose");
             std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
+            std::vector<std::string> dep_flags;
+            path dpath;
+            if(!opts.dep_flags.empty()){
+                dpath=get_dpath(working_path,src_base,file_in);
+                std::filesystem::create_directories(std::filesystem::path(dpath).remove_filename());
+                dep_flags=Util::map(opts.dep_flags,[dfile=dpath.string()](std::string flag){
+                    for(size_t i=0;(i=flag.find("%d",i))!=std::string::npos;i+=dfile.size()){
+                        flag.replace(i,2,dfile);
+                    }
+                    return flag;
+                });
+            }
             if(silent) Util::print_sync(std::filesystem::relative(file_in).string()+"\n");
-            return Util::run(compiler,Util::merge(std::vector<std::string>{"-c",file_in.string(),"-o",file_out.string()},flags,defines_calc,extra_flags),&Util::alternate_cmdline_args_to_file_regular,silent,rd)==0;
+            const bool ok=Util::run(compiler,Util::merge(std::vector<std::string>{"-c",Util::project_relative(file_in).string(),"-o",file_out.string()},get_common_args(),dep_flags,extra_flags),&Util::alternate_cmdline_args_to_file_regular,silent,rd,working_path/"tmp")==0;
+            if(ok&&!dpath.empty())relativize_dfile(dpath);
+            invalidate_file(file_out);
+            if(!dpath.empty())invalidate_file(dpath);
+            if(ok&&(!dpath.empty()||!writes_dependency_file()))record_tokens(working_path,src_base,file_in); // gnu records its own, once its dependency file is made relative
+            return ok;
         }
         
-        path gnu::get_dpath(const path &working_path,const path &src_base,const path &src_file){
-            if(Util::is_subpath(src_base,src_file)){
-                return working_path/"tmp"/(std::filesystem::relative(src_file,src_base).string()+".d");
+        path generic::get_dpath(const path &working_path,const path &src_base,const path &src_file){
+            if(auto rel=Util::subpath_relative(src_base,src_file)){
+                return working_path/"tmp"/(rel->string()+".d");
             }else{
                 throw std::runtime_error("source files outside src base directory not supported");
             }
         }
         
-        path gnu::get_out(const path &working_path,const path &src_base,const path &src_file){
-            if(Util::is_subpath(src_base,src_file)){
-                return (working_path/"obj"/std::filesystem::relative(src_file,src_base)).string()+".o";
+        path generic::get_out(const path &working_path,const path &src_base,const path &src_file){
+            if(auto rel=Util::subpath_relative(src_base,src_file)){
+                return (working_path/"obj"/(*rel)).string()+".o";
             }else{
                 throw std::runtime_error("source files outside src base directory not supported");
             }
         }
         
-        static std::map<path,std::filesystem::file_time_type> filetime_cache;
+        path generic::get_tpath(const path &working_path,const path &src_base,const path &src_file){
+            return path(get_dpath(working_path,src_base,src_file)).replace_extension(".tok");
+        }
+        
+        path generic::get_dwo(const path &file_out){
+            return path(file_out).replace_extension(".dwo");
+        }
         
-        static std::filesystem::file_time_type get_cached_file_write_time(const path& file){
-            if(filetime_nocache){
-                return std::filesystem::last_write_time(file);
-            }else if(auto it=filetime_cache.find(file);it!=filetime_cache.end()){
-                return it->second;
+        path gnu::get_ddi(const path &working_path,const path &src_base,const path &src_file){
+            if(auto rel=Util::subpath_relative(src_base,src_file)){
+                return working_path/"tmp"/(rel->string()+".ddi");
             }else{
-                auto time=std::filesystem::last_write_time(file);
-                filetime_cache.insert({file,time});
-                return time;
+                throw std::runtime_error("source files outside src base directory not supported");
             }
         }
         
-        bool gnu::needs_compile(const path &working_path,const path &src_base,const path &file_in,const path &file_out) try {
+        gnu::gnu(const std::string &cmp,const std::vector<std::string> &fs,const std::vector<std::string> &ds,const options &o,bool l):generic(cmp,fs,ds,o),llvm(l){
+            
+        }
+        
+        static std::optional<std::filesystem::file_time_type> get_cached_file_write_time_opt(const path& file){
+            return filetime_cache.intern(file.string())->get();
+        }
+        
+        // prerequisites of the object file in a make dependency file, skipping the rules gcc adds for modules with -fmodules-ts,
+        // or with 'list', every non-empty line
+        static std::optional<std::vector<std::string>> read_dfile(const path &dfile,bool list){
+            if(list){
+                std::vector<std::string> files;
+                for(std::string line:Util::split(Util::readfile(dfile.string()),'\n')){
+                    if(!line.empty()&&line.back()=='\r')line.pop_back();
+                    if(!line.empty())files.push_back(line);
+                }
+                return files;
+            }
+            std::vector<std::string> rules;
+            std::string rule;
+            for(std::string line:Util::split(Util::readfile(dfile.string()),'\n')){
+                if(!line.empty()&&line.back()=='\r')line.pop_back();
+                if(!line.empty()&&line.back()=='\\'){
+                    line.pop_back();
+                    rule+=line+" ";
+                }else{
+                    rules.push_back(rule+line);
+                    rule.clear();
+                }
+            }
+            if(!rule.empty())rules.push_back(rule);
+            std::string target;
+            std::vector<std::string> files;
+            for(const std::string &r:rules){
+                size_t s=r.find(':');
+                if(s==std::string::npos||r.find("+=")!=std::string::npos)continue;
+                std::vector<std::string> targets=Util::split(r.substr(0,s),{' ','\t'});
+                if(targets.empty())continue;
+                if(target.empty()){
+                    target=targets[0];
+                }else if(targets[0]!=target){
+                    continue;
+                }
+                for(const std::string &f:Util::split(r.substr(s+1),{' ','\t'})){
+                    if(f!="|"&&!f.ends_with(".c++m"))files.emplace_back(f);
+                }
+            }
+            if(target.empty())return std::nullopt;
+            return files;
+        }
+        
+        // parsed dependency file, null if it is missing or malformed
+        static std::shared_ptr<const std::vector<filetime_cache_t::entry*>> get_cached_dfile(const path &dfile,bool list=false){
+            filetime_cache_t::entry * e=filetime_cache.intern(dfile.string());
+            {
+                std::lock_guard<std::mutex> lock(dfile_cache_mutex);
+                if(auto it=dfile_cache.find(e);it!=dfile_cache.end()){
+                    return it->second;
+                }
+            }
+            std::shared_ptr<const std::vector<filetime_cache_t::entry*>> deps;
+            if(e->get()){
+                try{
+                    if(auto files=read_dfile(dfile,list)){
+                        deps=std::make_shared<const std::vector<filetime_cache_t::entry*>>(Util::map(*files,[](const std::string &f){return filetime_cache.intern(f);}));
+                    }
+                }catch(std::exception &ex){
+                    deps=nullptr;
+                }
+            }
+            std::lock_guard<std::mutex> lock(dfile_cache_mutex);
+            dfile_cache.insert({e,deps});
+            return deps;
+        }
+        
+        bool generic::writes_dependency_file(){
+            return !opts.dep_flags.empty();
+        }
+        
+        bool gas::writes_dependency_file(){
+            return true;
+        }
+        
+        bool gnu::writes_dependency_file(){
+            return true;
+        }
+        
+        Tokens::syntax generic::source_syntax(const path &file_in){
+            return Tokens::syntax_of(file_in);
+        }
+        
+        Tokens::syntax gas::source_syntax(const path &){
+            return Tokens::SYNTAX_GAS;
+        }
+        
+        Tokens::syntax nasm::source_syntax(const path &){
+            return Tokens::SYNTAX_NASM;
+        }
+        
+        void generic::record_tokens(const path &working_path,const path &src_base,const path &file_in){
+            if(!token_hash)return;
+            const path tpath=get_tpath(working_path,src_base,file_in);
+            const std::string src=Util::project_relative(file_in).string();
+            try{
+                std::string data(token_hashes_header);
+                auto add=[&data](const std::string &file,Tokens::syntax syn){
+                    if(auto hash=get_token_hash(file,syn))data+=*hash+" "+file+"\n";
+                };
+                add(src,source_syntax(file_in));
+                if(writes_dependency_file()){
+                    for(const std::string &dep:read_dfile(get_dpath(working_path,src_base,file_in),opts.dep_format=="list").value_or(std::vector<std::string>{})){
+                        if(dep!=src)add(dep,Tokens::syntax_of(dep));
+                    }
+                }
+                Util::writefile(tpath.string(),data);
+            }catch(std::exception &e){
+                // without token hashes the source is recompiled whenever it or a dependency is newer than the object
+                std::error_code ec;
+                std::filesystem::remove(tpath,ec);
+            }
+        }
+        
+        bool generic::check(const path &working_path,const path &src_base,const path &file_in,const path &file_out,explanation * why) try {
             static bool rebuild=Args::has_flag("rebuild");
-            path dfile=get_dpath(working_path,src_base,file_in);
-            if(!std::filesystem::exists(dfile)||rebuild)return true;
-            auto ctime=get_cached_file_write_time(file_out);
+            auto because=[why](const std::string &reason){
+                if(why)why->reason=reason;
+                return true;
+            };
+            if(rebuild)return because("-rebuild");
+            std::shared_ptr<const std::vector<filetime_cache_t::entry*>> deps;
+            if(writes_dependency_file()){
+                const path dfile=get_dpath(working_path,src_base,file_in);
+                deps=get_cached_dfile(dfile,opts.dep_format=="list");
+                if(!deps)return because((get_cached_file_write_time_opt(dfile)?"malformed dependency file ":"no dependency file ")+Util::quote_str_single(dfile.string()));
+            }
+            if(opts.split_dwarf&&!get_cached_file_write_time_opt(get_dwo(file_out)))return because("no split debug info file "+Util::quote_str_single(get_dwo(file_out).string()));
+            auto ctime=get_cached_file_write_time_opt(file_out);
+            if(!ctime)return because("no object file");
             
-            if(get_cached_file_write_time(file_in)>ctime)return true;
+            // with token_hash, files that are only newer are compared against the token hashes the object was compiled from
+            std::vector<std::pair<std::string,Tokens::syntax>> newer;
+            const std::string src=token_hash?Util::project_relative(file_in).string():"";
             
-            std::vector<path> files(({
-                std::string data=Util::readfile(dfile.string());
-                size_t s=data.find(':');
-                if(s==std::string::npos){
-                    return true;//MALFORMED
-                }
-                Util::map(Util::filter_if(Util::split(data.substr(s+1),{'\n','\r',' '}),[](const std::string &ss){return ss!="\\";}),[](const std::string &ss){return path(ss);});
-            }));
+            auto time=get_cached_file_write_time_opt(file_in);
+            if(!time||*time>*ctime){
+                if(!token_hash||!time)return because("source newer than the object file");
+                newer.push_back({src,source_syntax(file_in)});
+            }
             
-            for(auto &p:files){
-                if(get_cached_file_write_time(p)>ctime){
+            for(filetime_cache_t::entry * dep:deps?*deps:std::vector<filetime_cache_t::entry*>{}){
+                auto dep_time=dep->get();
+                if(!dep_time||*dep_time>*ctime){
+                    if(token_hash&&dep_time){
+                        if(*dep->name!=src)newer.push_back({*dep->name,Tokens::syntax_of(*dep->name)});
+                        continue;
+                    }
+                    if(!why)return true;
+                    why->changed.push_back(*dep->name);
+                }
+            }
+            if(why&&why->changed.size()>0){
+                const std::string &first=why->changed[0];
+                why->reason=Util::quote_str_single(first)+(get_cached_file_write_time_opt(first)?" newer than the object file":" no longer exists");
+                if(why->changed.size()>1)why->reason+=" (and "+std::to_string(why->changed.size()-1)+" more)";
+                return true;
+            }
+            if(newer.size()>0){
+                const path tpath=get_tpath(working_path,src_base,file_in);
+                auto recorded=read_token_hashes(tpath,*ctime);
+                if(!recorded)return because("no token hashes for the object file, and "+Util::quote_str_single(newer[0].first)+" is newer");
+                for(const auto &[file,syn]:newer){
+                    auto it=recorded->find(file);
+                    if(it==recorded->end()||get_token_hash(file,syn)!=it->second){
+                        if(!why)return true;
+                        why->changed.push_back(file);
+                    }
+                }
+                if(why&&why->changed.size()>0){
+                    why->reason=Util::quote_str_single(why->changed[0])+" changed since the object file was compiled";
+                    if(why->changed.size()>1)why->reason+=" (and "+std::to_string(why->changed.size()-1)+" more)";
                     return true;
                 }
+                if(!why){
+                    // only comments/whitespace changed, bring the object (and its token hashes, which must stay at least as new) up to date so the next build doesn't lex again
+                    const auto now=std::filesystem::file_time_type::clock::now();
+                    std::filesystem::last_write_time(file_out,now);
+                    std::filesystem::last_write_time(tpath,now);
+                    invalidate_file(file_out);
+                }
             }
             return false;
         }catch(std::exception &e){
+            if(why)why->reason="error while checking dependencies: "+std::string(e.what());
             return true;
         }
         
+        bool generic::needs_compile(const path &working_path,const path &src_base,const path &file_in,const path &file_out){
+            return check(working_path,src_base,file_in,file_out,nullptr);
+        }
+        
+        std::optional<std::vector<std::string>> generic::get_dependencies(const path &working_path,const path &src_base,const path &file_in){
+            if(!writes_dependency_file())return std::nullopt;
+            if(auto deps=get_cached_dfile(get_dpath(working_path,src_base,file_in),opts.dep_format=="list")){
+                return Util::map(*deps,[](filetime_cache_t::entry * dep){return *dep->name;});
+            }
+            return std::nullopt;
+        }
+        
+        std::vector<path> generic::get_outputs(const path &working_path,const path &src_base,const path &file_in,const path &file_out){
+            // .d/.dwo regardless of the current options, the source may have been compiled with different ones
+            return {file_out,get_dpath(working_path,src_base,file_in),get_dwo(file_out),get_tpath(working_path,src_base,file_in)};
+        }
+        
+        std::vector<path> gnu::get_outputs(const path &working_path,const path &src_base,const path &file_in,const path &file_out){
+            return Util::merge(generic::get_outputs(working_path,src_base,file_in,file_out),std::vector<path>{get_ddi(working_path,src_base,file_in)});
+        }
+        
+        explanation generic::explain(const path &working_path,const path &src_base,const path &file_in,const path &file_out){
+            explanation why;
+            check(working_path,src_base,file_in,file_out,&why);
+            return why;
+        }
+        
+        void generic::prefetch(const path &working_path,const path &src_base,const std::vector<std::pair<path,path>> &files){
+            const int stat_threads=io_threads();
+            if(filetime_nocache||Args::has_flag("rebuild"))return;
+            std::atomic<size_t> next=0;
+            auto worker=[&](){
+                for(size_t i;(i=next++)<files.size();){
+                    const auto &[file_in,file_out]=files[i];
+                    try{
+                        get_cached_file_write_time_opt(file_in);
+                        get_cached_file_write_time_opt(file_out);
+                        if(opts.split_dwarf)get_cached_file_write_time_opt(get_dwo(file_out));
+                        if(!writes_dependency_file())continue;
+                        if(auto deps=get_cached_dfile(get_dpath(working_path,src_base,file_in),opts.dep_format=="list")){
+                            for(filetime_cache_t::entry * dep:*deps){
+                                dep->get();
+                            }
+                        }
+                    }catch(std::exception &e){
+                        // needs_compile runs into the same error later, and reports it
+                    }
+                }
+            };
+            std::vector<std::thread> threads;
+            for(int i=1;i<stat_threads&&size_t(i)<files.size();i++){
+                threads.emplace_back(worker);
+            }
+            worker();
+            for(std::thread &t:threads){
+                t.join();
+            }
+        }
+        
+        static const std::vector<std::string> c_cpp_extensions{".c",".cpp",".c++",".cxx",".cc",".C"};
+        
+        static const char * cache_manifest_header="RBuild cache 1";
+        
+        // the action cache entry of a source lists the hash of its object, then the hash and path of every file it was compiled from
+        static remote_cache_t::entry cache_lookup(const std::string &key){
+            remote_cache_t::entry e{key,std::nullopt,{}};
+            auto manifest=Remote::cache_get("ac",key);
+            if(!manifest)return e;
+            std::vector<std::string> lines=Util::split(*manifest,'\n');
+            if(lines.size()<2||lines[0]!=cache_manifest_header)return e;
+            std::vector<std::string> deps;
+            for(size_t i=2;i<lines.size();i++){
+                size_t space=lines[i].find(' ');
+                if(space==std::string::npos)return e;
+                std::string dep=lines[i].substr(space+1);
+                if(remote_cache.content_hash(dep)!=lines[i].substr(0,space))return e; // compiled against different headers
+                deps.push_back(std::move(dep));
+            }
+            e.object=Remote::cache_get("cas",lines[1]);
+            if(e.object)e.deps=std::move(deps);
+            return e;
+        }
+        
+        static void cache_upload(const std::string &key,const path &file_out,const path &dpath){
+            auto deps=read_dfile(dpath,false);
+            if(!deps)return;
+            std::string object=Util::readfile(file_out.string(),true);
+            std::string object_hash=Util::sha256(object);
+            std::string manifest=std::string(cache_manifest_header)+"\n"+object_hash+"\n";
+            for(const std::string &dep:*deps){
+                auto hash=remote_cache.content_hash(dep);
+                if(!hash)return;
+                manifest+=*hash+" "+dep+"\n";
+            }
+            Remote::cache_put("cas",object_hash,object);
+            Remote::cache_put("ac",key,manifest);
+        }
+        
+        bool gnu::cacheable(const path &file_in){
+            return Remote::cache_enabled()&&!opts.split_dwarf&&Util::contains(c_cpp_extensions,file_in.extension().string());
+        }
+        
+        void gnu::start_cache_lookup(const path &src_base,const path &file_in,const path &file_out){
+            static bool rebuild=Args::has_flag("rebuild");
+            auto rel=Util::subpath_relative(src_base,file_in);
+            if(!rel)throw std::runtime_error("source files outside src base directory not supported");
+            // everything the lookup needs is copied, it may outlive the driver
+            remote_cache.start_lookup(file_out.string(),[compiler=compiler,signature=Util::relativize_paths(get_signature()),rel=rel->generic_string(),file_in=Util::project_relative(file_in).string()](){
+                try{
+                    auto hash=remote_cache.content_hash(file_in);
+                    if(!hash)return remote_cache_t::entry{};
+                    const std::string key=Util::sha256(std::string(cache_manifest_header)+"\n"+Toolchain::get(compiler).version+"\n"+signature+"\n"+rel+"\n"+*hash);
+                    return rebuild?remote_cache_t::entry{key,std::nullopt,{}}:cache_lookup(key); // -rebuild still uploads, but doesn't take objects from the cache
+                }catch(std::exception &e){
+                    return remote_cache_t::entry{};
+                }
+            });
+        }
+        
+        bool gnu::needs_compile(const path &working_path,const path &src_base,const path &file_in,const path &file_out){
+            const bool dirty=generic::needs_compile(working_path,src_base,file_in,file_out);
+            if(dirty&&cacheable(file_in))start_cache_lookup(src_base,file_in,file_out);
+            return dirty;
+        }
+        
         bool gnu::compile(const path &working_path,const path &src_base,const path &file_in,const path &file_out,const std::vector<std::string> &extra_args,Util::redirect_data * rd){
             const path dpath=get_dpath(working_path,src_base,file_in);
             std::filesystem::create_directories(std::filesystem::path(dpath).remove_filename());
-            return generic::compile(working_path,src_base,file_in,file_out,Util::merge(std::vector<std::string>{include_check,"-MF"+dpath.string()},extra_args),rd);
+            std::vector<std::string> gnu_args{include_check,"-MF"+dpath.string(),"-ffile-prefix-map="+Util::project_root().string()+"=."};
+            if(opts.split_dwarf){
+                gnu_args.push_back("-gsplit-dwarf");
+            }
+            if(opts.lto==LTO_FULL){
+                gnu_args.push_back("-flto");
+            }else if(opts.lto==LTO_THIN){
+                gnu_args.push_back("-flto=thin");
+            }
+            std::optional<remote_cache_t::entry> cached;
+            if(extra_args.empty()&&cacheable(file_in)){
+                start_cache_lookup(src_base,file_in,file_out);
+                cached=remote_cache.take_lookup(file_out.string());
+                if(cached->object){
+                    std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
+                    Util::writefile(file_out.string(),*cached->object,true);
+                    Util::writefile(dpath.string(),file_out.string()+":"+Util::join(Util::map(cached->deps,[](const std::string &dep){return " \\\n "+dep;}),"")+"\n");
+                    invalidate_file(file_out);
+                    invalidate_file(dpath);
+                    record_tokens(working_path,src_base,file_in);
+                    Util::print_sync(std::filesystem::relative(file_in).string()+" (cached)\n");
+                    return true;
+                }
+            }
+            std::optional<bool> remote_ok;
+            if(Remote::enabled()&&!opts.split_dwarf&&extra_args.empty()){
+                remote_ok=compile_remote(working_path,src_base,file_in,file_out,rd);
+            }
+            const bool ok=remote_ok?*remote_ok:generic::compile(working_path,src_base,file_in,file_out,Util::merge(gnu_args,extra_args),rd);
+            if(ok)relativize_dfile(dpath);
+            invalidate_file(dpath);
+            if(opts.split_dwarf)invalidate_file(get_dwo(file_out));
+            if(ok)record_tokens(working_path,src_base,file_in);
+            if(ok&&cached&&!cached->key.empty()){
+                cache_upload(cached->key,file_out,dpath);
+            }
+            return ok;
+        }
+        
+        // flags that only matter when preprocessing, which happens locally
+        static std::vector<std::string> strip_preprocessor_flags(const std::vector<std::string> &flags){
+            static const std::vector<std::string> with_value{"-I","-D","-U","-isystem","-iquote","-idirafter","-include","-imacros","-MF","-MT","-MQ"};
+            std::vector<std::string> out;
+            for(size_t i=0;i<flags.size();i++){
+                const std::string &f=flags[i];
+                if(Util::contains(with_value,f)){
+                    i++;
+                }else if(!(f.starts_with("-I")||f.starts_with("-D")||f.starts_with("-U")||f.starts_with("-M")||f.starts_with("-isystem")||f.starts_with("-iquote")||f.starts_with("-idirafter"))){
+                    out.push_back(f);
+                }
+            }
+            return out;
+        }
+        
+        std::optional<bool> gnu::compile_remote(const path &working_path,const path &src_base,const path &file_in,const path &file_out,Util::redirect_data * rd){
+            static bool silent=!Args::has_flag("verbose");
+            const std::string ext=file_in.extension().string();
+            if(!Util::contains(c_cpp_extensions,ext))return std::nullopt;
+            
+            auto rel=Util::subpath_relative(src_base,file_in);
+            if(!rel)throw std::runtime_error("source files outside src base directory not supported");
+            const std::string preprocessed_ext=(ext==".c")?".i":".ii";
+            const path ipath=working_path/"tmp"/(rel->string()+preprocessed_ext);
+            const path dpath=get_dpath(working_path,src_base,file_in);
+            std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
+            
+            // preprocess locally, writing the dependency file as a regular compile would
+            if(silent) Util::print_sync(std::filesystem::relative(file_in).string()+"\n");
+            Util::redirect_data pp_out;
+            const int pp_status=Util::run(compiler,Util::merge(std::vector<std::string>{"-E",Util::project_relative(file_in).string(),"-o",ipath.string(),include_check,"-MF"+dpath.string(),"-MT",file_out.string(),"-ffile-prefix-map="+Util::project_root().string()+"=."},get_common_args()),&Util::alternate_cmdline_args_to_file_regular,silent,&pp_out,working_path/"tmp");
+            pp_out.stop();
+            
+            std::optional<Remote::response> res;
+            if(pp_status==0){
+                // line markers in the preprocessed source still have the project's location in them
+                std::vector<std::string> args{"-c","%w/in"+preprocessed_ext,"-o","%w/out.o","-ffile-prefix-map="+Util::project_root().string()+"=."};
+                if(opts.lto==LTO_FULL){
+                    args.push_back("-flto");
+                }else if(opts.lto==LTO_THIN){
+                    args.push_back("-flto=thin");
+                }
+                res=Remote::execute({
+                    .program=compiler,
+                    .args=Util::merge(args,strip_preprocessor_flags(flags)),
+                    .inputs={{"in"+preprocessed_ext,Util::readfile(ipath.string(),true)}},
+                    .outputs={"out.o"},
+                });
+                std::error_code ec;
+                std::filesystem::remove(ipath,ec);
+                if(!res)return std::nullopt; // no workers left, compile locally
+            }
+            
+            const std::string s_stdout=pp_out.s_stdout+(res?res->s_stdout:"");
+            const std::string s_stderr=pp_out.s_stderr+(res?res->s_stderr:"");
+            if(rd){
+                rd->s_stdout+=s_stdout;
+                rd->s_stderr+=s_stderr;
+            }else{
+                if(!s_stdout.empty())Util::print_sync(s_stdout);
+                if(!s_stderr.empty())std::cerr<<s_stderr;
+            }
+            
+            if(!res||res->status!=0||!res->outputs[0])return false;
+            Util::writefile(file_out.string(),*res->outputs[0],true);
+            invalidate_file(file_out);
+            return true;
+        }
+        
+        static module_deps read_p1689(const path &ddi){
+            module_deps deps;
+            const JSON::Element data=JSON::parse(Util::readfile(ddi.string()));
+            for(const JSON::Element &rule:data.get_obj().at("rules").get_arr()){
+                const JSON::object_t &r=rule.get_obj();
+                if(auto it=r.find("provides");it!=r.end()){
+                    for(const JSON::Element &m:it->second.get_arr())deps.provides.push_back(m.get_obj().at("logical-name").get_str());
+                }
+                if(auto it=r.find("requires");it!=r.end()){
+                    for(const JSON::Element &m:it->second.get_arr())deps.imports.push_back(m.get_obj().at("logical-name").get_str());
+                }
+            }
+            return deps;
+        }
+        
+        // clang-scan-deps matching the compiler, 'clang++-17' -> 'clang-scan-deps-17'
+        static std::string get_clang_scan_deps(const std::string &compiler){
+            const path cpath(compiler);
+            const std::string name=cpath.filename().string();
+            for(const std::string prefix:{"clang++","clang"}){
+                if(name.starts_with(prefix)){
+                    const path scan_deps=path(cpath).replace_filename("clang-scan-deps"+name.substr(prefix.size()));
+                    if(std::filesystem::exists(scan_deps))return scan_deps.string();
+                    break;
+                }
+            }
+            return Util::find_executable("clang-scan-deps");
+        }
+        
+        module_deps gnu::scan_modules(const path &working_path,const path &src_base,const path &file_in,const path &file_out,bool rescan,Util::redirect_data * rd){
+            static bool silent=!Args::has_flag("verbose");
+            const path ddi=get_ddi(working_path,src_base,file_in);
+            if(rescan||!std::filesystem::exists(ddi)){
+                std::filesystem::create_directories(path(ddi).remove_filename());
+                bool ok;
+                if(llvm){
+                    const std::string scan_deps=get_clang_scan_deps(compiler);
+                    Util::redirect_data scan_out;
+                    ok=Util::run(scan_deps,Util::merge(std::vector<std::string>{"-format=p1689","--",compiler,"-c",Util::project_relative(file_in).string(),"-o",file_out.string()},get_common_args()),&Util::alternate_cmdline_args_to_file_regular,silent,&scan_out,working_path/"tmp")==0;
+                    scan_out.stop();
+                    if(rd){
+                        rd->s_stderr+=scan_out.s_stderr;
+                    }else{
+                        std::cerr<<scan_out.s_stderr;
+                    }
+                    if(ok)Util::writefile(ddi.string(),scan_out.s_stdout);
+                }else{
+                    #ifdef _WIN32
+                        const std::string null_device="NUL";
+                    #else
+                        const std::string null_device="/dev/null";
+                    #endif
+                    ok=Util::run(compiler,Util::merge(std::vector<std::string>{"-E","-x","c++",Util::project_relative(file_in).string(),"-o",null_device,"-fmodules-ts","-fdeps-format=p1689r5","-fdeps-file="+ddi.string(),"-fdeps-target="+file_out.string()},get_common_args()),&Util::alternate_cmdline_args_to_file_regular,silent,rd,working_path/"tmp")==0;
+                }
+                if(!ok){
+                    std::filesystem::remove(ddi);
+                    throw std::runtime_error("could not scan "+Util::quote_str_single(std::filesystem::relative(file_in).string())+" for module dependencies");
+                }
+            }
+            return read_p1689(ddi);
+        }
+        
+        path gnu::get_bmi(const path &working_path,const std::string &module_name){
+            std::string name(module_name);
+            std::replace(name.begin(),name.end(),':','-');// partitions, 'mod:part' -> 'mod-part', the name clang expects in prebuilt module paths
+            return working_path/"tmp"/"bmi"/(name+(llvm?".pcm":".gcm"));
+        }
+        
+        void gnu::prepare_modules(const path &working_path,const std::vector<std::string> &module_names){
+            std::filesystem::create_directories(working_path/"tmp"/"bmi");
+            if(!llvm){
+                std::string map;
+                for(const std::string &name:module_names){
+                    map+=name+" "+get_bmi(working_path,name).string()+"\n";
+                }
+                Util::writefile((working_path/"tmp"/"modules.map").string(),map);
+            }
+        }
+        
+        std::vector<std::string> gnu::module_flags(const path &working_path,const module_deps &deps){
+            if(llvm){
+                std::vector<std::string> args{"-fprebuilt-module-path="+(working_path/"tmp"/"bmi").string()};
+                for(const std::string &name:deps.provides){
+                    args.push_back("-fmodule-output="+get_bmi(working_path,name).string());
+                }
+                return args;
+            }else{
+                return {"-fmodules-ts","-fmodule-mapper="+(working_path/"tmp"/"modules.map").string()};
+            }
         }
         
         void gas::calc_defines(){
@@ -112,21 +869,31 @@ namespace drivers {
         }
         
         bool gas::compile(const path &working_path,const path &src_base,const path &file_in,const path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd){
-            calc_defines();
             static bool silent=!Args::has_flag("verbose");
+            const path dpath=get_dpath(working_path,src_base,file_in);
+            std::filesystem::create_directories(std::filesystem::path(dpath).remove_filename());
             std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
             if(silent) Util::print_sync(std::filesystem::relative(file_in).string()+"\n");
-            return Util::run(compiler,Util::merge(std::vector<std::string>{file_in.string(),"-o",file_out.string()},flags,defines_calc,extra_flags),&Util::alternate_cmdline_args_to_file_regular,silent,rd)==0;
+            const bool ok=Util::run(compiler,Util::merge(std::vector<std::string>{Util::project_relative(file_in).string(),"-o",file_out.string(),"--MD",dpath.string()},get_common_args(),extra_flags),&Util::alternate_cmdline_args_to_file_regular,silent,rd,working_path/"tmp")==0;
+            if(ok)relativize_dfile(dpath);
+            invalidate_file(file_out);
+            invalidate_file(dpath);
+            if(ok)record_tokens(working_path,src_base,file_in);
+            return ok;
         }
         
         bool nasm::compile(const path &working_path,const path &src_base,const path &file_in,const path &file_out,const std::vector<std::string> &extra_flags,Util::redirect_data * rd){
-            calc_defines();
             static bool silent=!Args::has_flag("verbose");
             const path dpath=get_dpath(working_path,src_base,file_in);
             std::filesystem::create_directories(std::filesystem::path(dpath).remove_filename());
             std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
             if(silent) Util::print_sync(std::filesystem::relative(file_in).string()+"\n");
-            return Util::run(compiler,Util::merge(std::vector<std::string>{file_in.string(),"-o",file_out.string()},flags,defines_calc,std::vector<std::string>{include_check,"-MF",dpath.string()},extra_flags),&Util::alternate_cmdline_args_to_file_nasm,silent,rd)==0;
+            const bool ok=Util::run(compiler,Util::merge(std::vector<std::string>{Util::project_relative(file_in).string(),"-o",file_out.string()},get_common_args(),std::vector<std::string>{include_check,"-MF",dpath.string()},extra_flags),&Util::alternate_cmdline_args_to_file_nasm,silent,rd,working_path/"tmp")==0;
+            if(ok)relativize_dfile(dpath);
+            invalidate_file(file_out);
+            invalidate_file(dpath);
+            if(ok)record_tokens(working_path,src_base,file_in);
+            return ok;
         }
         
     }
@@ -139,7 +906,7 @@ namespace drivers {
             
         }
         
-        base::base(const std::string &lnk,const std::vector<std::string> &fs,const std::vector<std::string> &ls):linker(lnk),flags(fs),libs(ls){
+        base::base(const std::string &lnk,const std::vector<std::string> &fs,const std::vector<std::string> &ls,const options &o):linker(Util::find_executable(lnk)),flags(fs),libs(ls),opts(o){
             if(force_static_link){
                 flags.push_back("-static");
             }
@@ -163,6 +930,56 @@ namespace drivers {
             return out;
         }
         
+        std::string base::get_signature(){
+            return Util::join(Util::merge(std::vector<std::string>{typeid(*this).name(),linker,std::to_string(force_static_link),std::to_string(opts.ar_incremental),std::to_string(opts.ar_thin),opts.backend,std::to_string(opts.dwp),std::to_string(opts.lto)},flags,libs),"\n");
+        }
+        
+        std::vector<path> base::get_files(){
+            std::vector<path> out;
+            for(auto &vp:link_files){
+                out.insert(out.end(),vp.second.begin(),vp.second.end());
+            }
+            return out;
+        }
+        
+        std::vector<path> base::get_lib_files(){
+            const std::vector<std::string> args=Util::merge(flags,libs);
+            std::vector<path> lib_folders;
+            for(size_t i=0;i<args.size();i++){
+                if(args[i]=="-L"&&i+1<args.size()){
+                    lib_folders.push_back(args[++i]);
+                }else if(args[i].starts_with("-L")){
+                    lib_folders.push_back(args[i].substr(2));
+                }
+            }
+            std::vector<path> out;
+            for(size_t i=0;i<args.size();i++){
+                if(args[i]=="-L"){
+                    i++;
+                }else if(args[i].starts_with("-l")&&args[i].size()>2){
+                    const std::string lib=args[i].substr(2);
+                    const std::vector<std::string> names=lib.starts_with(":")?std::vector<std::string>{lib.substr(1)}:std::vector<std::string>{"lib"+lib+".so","lib"+lib+".a","lib"+lib+".dll.a",lib+".lib"};
+                    [&](){
+                        for(const path &folder:lib_folders){
+                            for(const std::string &name:names){
+                                if(std::filesystem::is_regular_file(folder/name)){
+                                    out.push_back(folder/name);
+                                    return;
+                                }
+                            }
+                        }
+                    }();
+                }else if(!args[i].starts_with("-")&&std::filesystem::is_regular_file(args[i])){
+                    out.push_back(args[i]);
+                }
+            }
+            return out;
+        }
+        
+        const Toolchain::fingerprint& base::get_fingerprint(){
+            return Toolchain::get(linker); // the C++ linker once gnu::add_file saw a C++ object
+        }
+        
         bool base::link(const path &working_path,const path &file_out,const std::vector<std::string> &extra_flags){
             static bool silent=!Args::has_flag("verbose");
             std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
@@ -185,10 +1002,10 @@ namespace drivers {
             static bool silent=!Args::has_flag("verbose");
             std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
             if(silent)std::cout<<"linking\n";
-            return Util::run(linker,Util::merge(std::vector<std::string>{"-o",file_out.string()},flags,extra_flags,join_link_files(),libs),&Util::alternate_cmdline_args_to_file_regular,silent)==0;
+            return Util::run(linker,Util::merge(std::vector<std::string>{"-o",file_out.string()},flags,extra_flags,join_link_files(),libs),&Util::alternate_cmdline_args_to_file_regular,silent,nullptr,working_path/"tmp")==0;
         }
         
-        gnu::gnu(const std::string &lnk,const std::string &lnk_cpp,const std::vector<std::string> &fs,const std::vector<std::string> &ls) : generic(lnk,fs,ls),linker_cpp(lnk_cpp) {
+        gnu::gnu(const std::string &lnk,const std::string &lnk_cpp,const std::vector<std::string> &fs,const std::vector<std::string> &ls,bool l,const options &o) : generic(lnk,fs,ls,o),llvm(l),linker_cpp(Util::find_executable(lnk_cpp)) {
             
         }
         
@@ -200,43 +1017,163 @@ namespace drivers {
             generic::add_file(link_order,f);
         }
         
+        bool gnu::link(const path &working_path,const path &file_out,const std::vector<std::string> &extra_flags){
+            std::vector<std::string> backend_flags;
+            if(!opts.backend.empty()){
+                backend_flags.push_back("-fuse-ld="+opts.backend);
+                if(opts.threads>0){
+                    if(opts.backend=="mold"){
+                        backend_flags.push_back("-Wl,--thread-count="+std::to_string(opts.threads));
+                    }else if(opts.backend=="lld"){
+                        backend_flags.push_back("-Wl,--threads="+std::to_string(opts.threads));
+                    }else if(opts.backend=="gold"){
+                        backend_flags.push_back("-Wl,--threads,--thread-count="+std::to_string(opts.threads));
+                    }
+                }
+            }
+            if(opts.lto==LTO_FULL){
+                if(llvm){
+                    backend_flags.push_back("-flto");
+                }else{
+                    //gcc partitions the link-time optimization itself, and runs the partitions in parallel
+                    backend_flags.push_back(opts.threads>0?"-flto="+std::to_string(opts.threads):"-flto=auto");
+                }
+            }else if(opts.lto==LTO_THIN){
+                path cache_dir(working_path/"tmp"/"thinlto");
+                std::filesystem::create_directories(cache_dir);
+                backend_flags.push_back("-flto=thin");
+                if(opts.backend=="lld"){
+                    backend_flags.push_back("-Wl,--thinlto-cache-dir="+cache_dir.string());
+                    if(opts.threads>0)backend_flags.push_back("-Wl,--thinlto-jobs="+std::to_string(opts.threads));
+                }else{
+                    //bfd, gold and mold run ThinLTO through the LLVM linker plugin, which lld understands too, in case it's the compiler's default
+                    backend_flags.push_back("-Wl,-plugin-opt,cache-dir="+cache_dir.string());
+                    if(opts.threads>0)backend_flags.push_back("-Wl,-plugin-opt,jobs="+std::to_string(opts.threads));
+                }
+            }
+            if(!generic::link(working_path,file_out,Util::merge(backend_flags,extra_flags))){
+                return false;
+            }
+            if(opts.dwp){
+                static bool silent=!Args::has_flag("verbose");
+                //binutils' dwp can't read DWARF 5, prefer llvm-dwp if it's installed
+                static const std::string dwp_tool=[](){
+                    std::string llvm_dwp=Util::find_executable("llvm-dwp");
+                    return llvm_dwp!="llvm-dwp"?llvm_dwp:Util::find_executable("dwp");
+                }();
+                if(silent)std::cout<<"packaging debug info\n";
+                return Util::run(dwp_tool,{"-e",file_out.string(),"-o",file_out.string()+".dwp"},nullptr,silent)==0;
+            }
+            return true;
+        }
+        
+        std::string detect_backend(){
+            static const std::string backend=[](){
+                static const std::pair<const char *,const char *> backends[]{
+                    {"mold","mold"},
+                    {"lld","ld.lld"},
+                    {"gold","ld.gold"},
+                };
+                for(auto &[name,binary]:backends){
+                    if(Util::find_executable(binary)!=binary){
+                        return std::string(name);
+                    }
+                }
+                return std::string();
+            }();
+            return backend;
+        }
+        
         std::string ar::get_ext(){
             return ".o";
         }
         
         bool ar::link(const path &working_path,const path &file_out,const std::vector<std::string> &extra_flags) {
             static bool silent=!Args::has_flag("verbose");
+            static bool rebuild=Args::has_flag("rebuild");
             std::filesystem::create_directories(std::filesystem::path(file_out).remove_filename());
+            std::vector<std::string> files(join_link_files());
+            std::vector<std::string> ar_flags(opts.ar_thin?Util::merge(flags,std::vector<std::string>{"--thin"}):flags);
+            path members_file(working_path/"tmp"/(file_out.filename().string()+".members"));
+            std::string members(Util::join(Util::merge(ar_flags,libs,files),"\n")); // with the flags, switching between thin/regular or changing flags recreates the archive
+            //regular archives match members by file name, replacing one of two objects with the same name would replace the wrong member or add a duplicate, thin archives keep the full path
+            auto unique_names=[&files](){
+                std::unordered_set<std::string> names;
+                for(const std::string &f:files){
+                    if(!names.insert(path(f).filename().string()).second)return false;
+                }
+                return true;
+            };
+            if(opts.ar_incremental&&!rebuild&&(opts.ar_thin||unique_names())&&std::filesystem::exists(file_out)&&std::filesystem::exists(members_file)&&Util::readfile(members_file.string())==members){
+                //same member list as the last link, only objects newer than the archive need to be replaced
+                auto archive_time=std::filesystem::last_write_time(file_out);
+                std::vector<std::string> changed(Util::filter_if(files,[archive_time](const std::string &f){
+                    return std::filesystem::last_write_time(f)>archive_time;
+                }));
+                if(changed.empty()){
+                    if(silent)std::cout<<"archive up to date\n";
+                    return true;
+                }
+                if(silent)std::cout<<"updating "<<changed.size()<<(changed.size()==1?" archive member\n":" archive members\n");
+                return Util::run(linker,Util::merge(ar_flags,std::vector<std::string>{file_out.string()},extra_flags,changed),&Util::alternate_cmdline_args_to_file_regular,silent,nullptr,working_path/"tmp")==0;
+            }
+            //without linker_ar_incremental there's no member list, a thin archive left from linker_ar_thin is told apart by its magic
+            auto is_thin_archive=[&file_out](){
+                std::ifstream f(file_out,std::ios::binary);
+                char magic[8]{};
+                return f.read(magic,sizeof(magic))&&memcmp(magic,"!<thin>\n",sizeof(magic))==0;
+            };
+            if(opts.ar_incremental||opts.ar_thin||is_thin_archive()){
+                //start from an empty archive, so that objects of removed sources don't linger, and ar doesn't refuse to switch between thin/regular (a switch changes 'members')
+                std::filesystem::remove(file_out);
+                std::filesystem::remove(members_file);
+            }
             if(silent)std::cout<<"linking\n";
-            return Util::run(linker,Util::merge(flags,std::vector<std::string>{file_out.string()},libs,extra_flags,join_link_files()),&Util::alternate_cmdline_args_to_file_regular,silent)==0;
+            if(Util::run(linker,Util::merge(ar_flags,std::vector<std::string>{file_out.string()},libs,extra_flags,files),&Util::alternate_cmdline_args_to_file_regular,silent,nullptr,working_path/"tmp")!=0){
+                return false;
+            }
+            if(opts.ar_incremental){
+                std::filesystem::create_directories(members_file.parent_path());
+                Util::writefile(members_file.string(),members);
+            }
+            return true;
         }
         
     }
     
-    std::unique_ptr<compiler::driver> get_compiler(const std::string &name,compiler_lang lang,const std::vector<std::string> &flags,const std::vector<std::string> &defines,const std::optional<std::string> &compiler_binary_override){
+    std::unique_ptr<compiler::driver> get_compiler(const std::string &name,compiler_lang lang,const std::vector<std::string> &flags,const std::vector<std::string> &defines,const std::optional<std::string> &compiler_binary_override,const compiler::options &opts_in){
+        compiler::options opts(opts_in);
+        if(name=="gcc"&&opts.lto==LTO_THIN){
+            opts.lto=LTO_FULL;
+        }
+        if(name!="generic"){
+            //dependency file options only apply to the generic driver, the others write make rules through their own flags
+            opts.dep_flags.clear();
+            opts.dep_format="make";
+        }
         switch(lang){
         case LANG_C:
         case LANG_CPP:
             if(name=="gcc"){
-                return std::make_unique<compiler::gnu>((lang==LANG_C?Args::namedArgOr("gcc_override",compiler_binary_override?*compiler_binary_override:"gcc"):Args::namedArgOr("gxx_override",compiler_binary_override?*compiler_binary_override:"g++")),flags,defines);
+                return std::make_unique<compiler::gnu>((lang==LANG_C?Args::namedArgOr("gcc_override",compiler_binary_override?*compiler_binary_override:"gcc"):Args::namedArgOr("gxx_override",compiler_binary_override?*compiler_binary_override:"g++")),flags,defines,opts);
             }else if(name=="clang"){
-                return std::make_unique<compiler::gnu>((lang==LANG_C?Args::namedArgOr("clang_override",compiler_binary_override?*compiler_binary_override:"clang"):Args::namedArgOr("clangxx_override",compiler_binary_override?*compiler_binary_override:"clang++")),flags,defines);
+                return std::make_unique<compiler::gnu>((lang==LANG_C?Args::namedArgOr("clang_override",compiler_binary_override?*compiler_binary_override:"clang"):Args::namedArgOr("clangxx_override",compiler_binary_override?*compiler_binary_override:"clang++")),flags,defines,opts,true);
             }else if(name=="generic"&&compiler_binary_override){
-                return std::make_unique<compiler::generic>(*compiler_binary_override,flags,defines);
+                return std::make_unique<compiler::generic>(*compiler_binary_override,flags,defines,compiler::options{.dep_flags=opts.dep_flags,.dep_format=opts.dep_format});
             }else{
                 throw std::runtime_error("unknown compiler "+Util::quote_str_single(name));
             }
         case LANG_ASM:
             if(name=="gcc"){
-                return std::make_unique<compiler::gnu>(Args::namedArgOr("gcc_override",compiler_binary_override?*compiler_binary_override:"gcc"),flags,defines);
+                return std::make_unique<compiler::gnu>(Args::namedArgOr("gcc_override",compiler_binary_override?*compiler_binary_override:"gcc"),flags,defines,opts);
             }else if(name=="clang"){
-                return std::make_unique<compiler::gnu>(Args::namedArgOr("clang_override",compiler_binary_override?*compiler_binary_override:"clang"),flags,defines);
+                return std::make_unique<compiler::gnu>(Args::namedArgOr("clang_override",compiler_binary_override?*compiler_binary_override:"clang"),flags,defines,opts,true);
             }else if(name=="generic"&&compiler_binary_override){
-                return std::make_unique<compiler::generic>(*compiler_binary_override,flags,defines);
+                return std::make_unique<compiler::generic>(*compiler_binary_override,flags,defines,compiler::options{.dep_flags=opts.dep_flags,.dep_format=opts.dep_format});
             }else if(name=="as"){
-                return std::make_unique<compiler::gas>(compiler_binary_override?*compiler_binary_override:name,flags,defines);
+                return std::make_unique<compiler::gas>(compiler_binary_override?*compiler_binary_override:name,flags,defines,opts);
             }else if(name=="nasm"){
-                return std::make_unique<compiler::nasm>(compiler_binary_override?*compiler_binary_override:name,flags,defines);
+                return std::make_unique<compiler::nasm>(compiler_binary_override?*compiler_binary_override:name,flags,defines,opts);
             }else{
                 throw std::runtime_error("unknown compiler "+Util::quote_str_single(name));
             }
@@ -249,17 +1186,28 @@ namespace drivers {
         __builtin_unreachable();
     }
     
-    std::unique_ptr<linker::driver> get_linker(const std::string &name,const std::vector<std::string> &flags,const std::vector<std::string> &libs,const std::optional<std::string> &linker_binary_override_c,const std::optional<std::string> &linker_binary_override_cpp,const std::optional<std::string> &linker_binary_override_other){
+    std::unique_ptr<linker::driver> get_linker(const std::string &name,const std::vector<std::string> &flags,const std::vector<std::string> &libs,const std::optional<std::string> &linker_binary_override_c,const std::optional<std::string> &linker_binary_override_cpp,const std::optional<std::string> &linker_binary_override_other,const linker::options &opts_in){
+        linker::options opts(opts_in);
+        if(opts.backend=="auto"){
+            opts.backend=linker::detect_backend();
+        }else if(opts.backend=="default"){
+            opts.backend.clear();
+        }else if(!opts.backend.empty()&&!Util::contains(std::vector<std::string>{"bfd","gold","lld","mold"},opts.backend)){
+            throw std::runtime_error("unknown linker backend "+Util::quote_str_single(opts.backend));
+        }
+        if(name=="gcc"&&opts.lto==LTO_THIN){
+            opts.lto=LTO_FULL;
+        }
         if(name=="gcc"){
-            return std::make_unique<linker::gnu>(Args::namedArgOr("gcc_override",linker_binary_override_c?*linker_binary_override_c:"gcc"),Args::namedArgOr("gxx_override",linker_binary_override_cpp?*linker_binary_override_cpp:"g++"),flags,libs);
+            return std::make_unique<linker::gnu>(Args::namedArgOr("gcc_override",linker_binary_override_c?*linker_binary_override_c:"gcc"),Args::namedArgOr("gxx_override",linker_binary_override_cpp?*linker_binary_override_cpp:"g++"),flags,libs,false,opts);
         }else if(name=="clang"){
-            return std::make_unique<linker::gnu>(Args::namedArgOr("clang_override",linker_binary_override_c?*linker_binary_override_c:"clang"),Args::namedArgOr("clangxx_override",linker_binary_override_cpp?*linker_binary_override_cpp:"clang++"),flags,libs);
+            return std::make_unique<linker::gnu>(Args::namedArgOr("clang_override",linker_binary_override_c?*linker_binary_override_c:"clang"),Args::namedArgOr("clangxx_override",linker_binary_override_cpp?*linker_binary_override_cpp:"clang++"),flags,libs,true,opts);
         }else if(name=="generic"&&linker_binary_override_other){
-            return std::make_unique<linker::generic>(*linker_binary_override_other,flags,libs);
+            return std::make_unique<linker::generic>(*linker_binary_override_other,flags,libs,opts);
         }else if(Util::contains(std::vector<std::string>{"ld","ld.gold","ld.lld"},name)){
-            return std::make_unique<linker::generic>(linker_binary_override_other?*linker_binary_override_other:name,flags,libs);
+            return std::make_unique<linker::generic>(linker_binary_override_other?*linker_binary_override_other:name,flags,libs,opts);
         }else if(Util::contains(std::vector<std::string>{"ar","llvm-ar"},name)){
-            return std::make_unique<linker::ar>(linker_binary_override_other?*linker_binary_override_other:name,flags,libs);
+            return std::make_unique<linker::ar>(linker_binary_override_other?*linker_binary_override_other:name,flags,libs,opts);
         }else{
             throw std::runtime_error("unknown linker "+Util::quote_str_single(name));
         }
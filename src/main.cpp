@@ -4,12 +4,13 @@
 #include "project.h"
 #include "util.h"
 #include "drivers.h"
+#include "remote.h"
 
 #include "args.h"
 
 #include <cstdlib>
 
-#define RBUILD_VERSION "0.0.0g"
+#define RBUILD_VERSION "0.0.0h"
 
 static bool show_warnings(std::vector<std::string> &warnings){
     bool show_prompt=true;
@@ -56,10 +57,19 @@ const char * valid_args[] {
     "num_jobs",
     "ignore_warnings",
     "filetime_nocache",
+    "token_hash",
     "incremental_build_exclude_system",
     "MMD",
     "static",
     "clean",
+    "explain",
+    "dry_run",
+    "header",
+    "top",
+    "workers",
+    "cache",
+    "shard",
+    "link_only",
 };
 
 int main(int argc,char ** argv) try {
@@ -86,6 +96,18 @@ int main(int argc,char ** argv) try {
         drivers::compiler::filetime_nocache=true;
     }
     
+    if(Args::has_flag("token_hash")){
+        drivers::compiler::token_hash=true;
+    }
+    
+    if(Args::named.contains("workers")){
+        Remote::set_workers(Util::split(Args::namedArg("workers"),','));
+    }
+    
+    if(Args::named.contains("cache")){
+        Remote::set_cache(Args::namedArg("cache"));
+    }
+    
     if(Args::has_flag("static")){
         drivers::linker::force_static_link=true;
     }
@@ -107,8 +129,10 @@ int main(int argc,char ** argv) try {
     
     std::string project_file=Args::namedArgOr("file",std::filesystem::current_path().filename().string()+".json");
     
-    auto project_json=JSON::parse(Util::readfile(project_file));
+    const std::string project_text=Util::readfile(project_file);
+    auto project_json=JSON::parse(project_text);
     Project project(project_json.get_obj(),warnings);
+    project.plan_key=Util::sha256(project_text)+"\n"+std::filesystem::current_path().string();
     
     {
         std::vector<std::string> invalid_args=Util::filter_exclude(Util::keys(Args::named),Util::CArrayIteratorAdaptor(valid_args));
@@ -117,14 +141,15 @@ int main(int argc,char ** argv) try {
         }
     }
     
-    std::vector<std::string> possible_targets=Util::merge(Util::keys(project.targets.targets),Util::keys(project.targets.target_groups));
+    std::vector<std::string> possible_targets=Util::merge(project.targets.names,Util::keys(project.targets.target_groups));
     
-    bool target_group_all_exists=!project.targets.target_groups.insert_or_assign("all",Util::keys(project.targets.targets)).second;
+    bool target_group_all_exists=!project.targets.target_groups.insert_or_assign("all",project.targets.names).second;
     
-    if(target_group_all_exists||project.targets.targets.contains("all")){
+    if(target_group_all_exists||project.targets.contains("all")){
         warnings.push_back(std::string(target_group_all_exists?"Target group":"Target")+" 'all' was defined by project, and overwritten (project must not define 'all' target)");
         if(!target_group_all_exists){
-            project.targets.targets.erase("all");
+            auto &names=project.targets.names;
+            names.erase(std::remove(names.begin(),names.end(),"all"),names.end());
         }
     }else{
         possible_targets.push_back("all");
@@ -132,16 +157,20 @@ int main(int argc,char ** argv) try {
     
     std::vector<std::string> valid_targets;
     
+    const bool do_deps=Args::unnamed.size()>0&&Args::unnamed[0]=="deps";
+    if(do_deps){
+        Args::unnamed.erase(Args::unnamed.begin());
+    }
+    
     if(Args::unnamed.size()==1&&Args::unnamed[0]=="list"){
+        project.load_targets(project.targets.names,warnings); // so that targets whose includes fail aren't listed
+        std::erase_if(possible_targets,[&project](const std::string &t){return !project.targets.contains(t)&&!project.targets.target_groups.contains(t);});
         if(!show_warnings(warnings)){
             return EXIT_FAILURE;
         }
         std::cout<<"targets: "<<Util::join(Util::map(possible_targets,&Util::quote_str_single),", ")<<"\n";
         return EXIT_SUCCESS;
     }else if(Args::unnamed.size()==0){
-        if(!show_warnings(warnings)){
-            return EXIT_FAILURE;
-        }
         valid_targets=project.default_targets;
     }else{
         std::vector<std::string> invalid_targets;
@@ -150,9 +179,12 @@ int main(int argc,char ** argv) try {
         if(invalid_targets.size()>0){
             warnings.push_back("Asking for Invalid "+std::string(invalid_targets.size()==1?"Target ":"Targets: ")+Util::join(Util::map(invalid_targets,&Util::quote_str_single),", "));
         }
-        if(!show_warnings(warnings)){
-            return EXIT_FAILURE;
-        }
+    }
+    
+    project.load_targets(valid_targets,warnings);
+    
+    if(!show_warnings(warnings)){
+        return EXIT_FAILURE;
     }
     
     const bool do_clean=Args::has_flag("clean");
@@ -160,6 +192,8 @@ int main(int argc,char ** argv) try {
     bool ok=true;
     if(valid_targets.size()==0){
         std::cout<<"----------------\nNo Targets\n----------------\n";
+    }else if(do_deps){
+        ok=project.show_deps(valid_targets,failexit);
     }else if(do_clean){
         ok=project.clean_targets(valid_targets,failexit);
     }else{
@@ -0,0 +1,212 @@
+#include "plan.h"
+#include "util.h"
+
+#include <cstring>
+
+// every integer is a little-endian u64, every string a u64 length followed by its bytes, optionals and booleans a u64 0/1 (followed by the value)
+//   "RBuild plan 1\n" key nplans (name plan)...
+
+static const char * plan_cache_header="RBuild plan 1\n";
+
+bool TargetPlan::sources_up_to_date() const {
+    for(const auto &[folder,time]:folders){
+        std::error_code ec;
+        auto t=std::filesystem::last_write_time(folder,ec);
+        if(ec||t.time_since_epoch().count()!=time)return false;
+    }
+    return true;
+}
+
+namespace {
+    
+    class writer {
+    public:
+        std::string buf;
+        
+        void u64(uint64_t n){
+            char b[8];
+            for(int i=0;i<8;i++)b[i]=char((n>>(i*8))&0xFF);
+            buf.append(b,8);
+        }
+        
+        void str(const std::string &s){
+            u64(s.size());
+            buf+=s;
+        }
+        
+        void opt(const std::optional<std::string> &s){
+            u64(s.has_value());
+            if(s)str(*s);
+        }
+        
+        void strs(const std::vector<std::string> &v){
+            u64(v.size());
+            for(const std::string &s:v)str(s);
+        }
+        
+        void compiler(const TargetPlan::compiler_t &c){
+            str(c.driver);
+            strs(c.flags);
+            strs(c.defines);
+            opt(c.binary);
+        }
+    };
+    
+    class reader {
+        const std::string &buf;
+        size_t pos;
+    public:
+        reader(const std::string &b,size_t p):buf(b),pos(p){}
+        
+        uint64_t u64(){
+            if(buf.size()-pos<8)throw std::runtime_error("truncated");
+            uint64_t n=0;
+            for(int i=0;i<8;i++)n|=uint64_t(uint8_t(buf[pos+i]))<<(i*8);
+            pos+=8;
+            return n;
+        }
+        
+        std::string str(){
+            uint64_t n=u64();
+            if(buf.size()-pos<n)throw std::runtime_error("truncated");
+            std::string s=buf.substr(pos,n);
+            pos+=n;
+            return s;
+        }
+        
+        std::optional<std::string> opt(){
+            if(u64())return str();
+            return std::nullopt;
+        }
+        
+        std::vector<std::string> strs(){
+            std::vector<std::string> v(u64());
+            for(std::string &s:v)s=str();
+            return v;
+        }
+        
+        TargetPlan::compiler_t compiler(){
+            TargetPlan::compiler_t c;
+            c.driver=str();
+            c.flags=strs();
+            c.defines=strs();
+            c.binary=opt();
+            return c;
+        }
+        
+        bool done(){
+            return pos==buf.size();
+        }
+    };
+    
+}
+
+PlanCache PlanCache::read(const std::filesystem::path &cache_file,const std::string &key) try {
+    PlanCache cache;
+    cache.key=key;
+    if(!std::filesystem::exists(cache_file))return cache;
+    const std::string data=Util::readfile(cache_file.string(),true);
+    if(!data.starts_with(plan_cache_header))return cache;
+    reader r(data,strlen(plan_cache_header));
+    if(r.str()!=key)return cache;
+    std::map<std::string,TargetPlan> plans;
+    for(uint64_t i=0,n=r.u64();i<n;i++){
+        std::string name=r.str();
+        TargetPlan &plan=plans[name];
+        plan.compiler_c=r.compiler();
+        plan.compiler_cpp=r.compiler();
+        plan.compiler_asm=r.compiler();
+        plan.linker=r.str();
+        plan.linker_flags=r.strs();
+        plan.linker_libs=r.strs();
+        plan.linker_binary_c=r.opt();
+        plan.linker_binary_cpp=r.opt();
+        plan.linker_binary_other=r.opt();
+        plan.linker_ar_incremental=r.u64();
+        plan.linker_ar_thin=r.u64();
+        plan.linker_backend=r.str();
+        plan.linker_order.resize(r.u64());
+        for(Targets::target::link_order_t &lo:plan.linker_order){
+            lo.name=r.str();
+            lo.weight=int64_t(r.u64());
+            lo.type=Targets::target::link_order_type_t(r.u64());
+        }
+        plan.split_dwarf=r.u64();
+        plan.split_dwarf_dwp=r.u64();
+        plan.lto=r.str();
+        plan.generic_dep_flags=r.strs();
+        plan.generic_dep_format=r.str();
+        plan.cpp_modules=r.u64();
+        plan.src_base=r.str();
+        plan.working_path=r.str();
+        plan.binary_folder=r.str();
+        plan.binary_name=r.str();
+        plan.binary_ext=r.opt();
+        plan.sources.resize(r.u64());
+        for(std::filesystem::path &src:plan.sources){
+            src=r.str();
+        }
+        plan.folders.resize(r.u64());
+        for(auto &[folder,time]:plan.folders){
+            folder=r.str();
+            time=int64_t(r.u64());
+        }
+    }
+    if(!r.done())return cache;
+    cache.plans=std::move(plans);
+    return cache;
+}catch(std::exception &e){
+    PlanCache cache;
+    cache.key=key;
+    return cache;
+}
+
+void PlanCache::write(const std::filesystem::path &cache_file) const {
+    writer w;
+    w.buf=plan_cache_header;
+    w.str(key);
+    w.u64(plans.size());
+    for(const auto &[name,plan]:plans){
+        w.str(name);
+        w.compiler(plan.compiler_c);
+        w.compiler(plan.compiler_cpp);
+        w.compiler(plan.compiler_asm);
+        w.str(plan.linker);
+        w.strs(plan.linker_flags);
+        w.strs(plan.linker_libs);
+        w.opt(plan.linker_binary_c);
+        w.opt(plan.linker_binary_cpp);
+        w.opt(plan.linker_binary_other);
+        w.u64(plan.linker_ar_incremental);
+        w.u64(plan.linker_ar_thin);
+        w.str(plan.linker_backend);
+        w.u64(plan.linker_order.size());
+        for(const Targets::target::link_order_t &lo:plan.linker_order){
+            w.str(lo.name);
+            w.u64(uint64_t(int64_t(lo.weight)));
+            w.u64(lo.type);
+        }
+        w.u64(plan.split_dwarf);
+        w.u64(plan.split_dwarf_dwp);
+        w.str(plan.lto);
+        w.strs(plan.generic_dep_flags);
+        w.str(plan.generic_dep_format);
+        w.u64(plan.cpp_modules);
+        w.str(plan.src_base.string());
+        w.str(plan.working_path.string());
+        w.str(plan.binary_folder.string());
+        w.str(plan.binary_name);
+        w.opt(plan.binary_ext);
+        w.u64(plan.sources.size());
+        for(const std::filesystem::path &src:plan.sources){
+            w.str(src.string());
+        }
+        w.u64(plan.folders.size());
+        for(const auto &[folder,time]:plan.folders){
+            w.str(folder.string());
+            w.u64(uint64_t(time));
+        }
+    }
+    std::filesystem::create_directories(std::filesystem::path(cache_file).remove_filename());
+    Util::writefile(cache_file.string(),w.buf,true);
+}
@@ -1,11 +1,20 @@
 #include "project.h"
 #include "drivers.h"
+#include "args.h"
+#include "deps.h"
 
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
 #include <stdexcept>
 #include <thread>
+#include <chrono>
+#include <iomanip>
 #include <queue>
+#include <mutex>
+#include <atomic>
 #include <unordered_set>
+#include <limits>
 
 Project::Project(const JSON::object_t &project,std::vector<std::string> &warnings_out) :
     targets(project.at("targets").get_obj(),warnings_out),
@@ -31,14 +40,15 @@ Project::Project(const JSON::object_t &project,std::vector<std::string> &warning
     linker_binary_override_c_cpp(JSON::str_opt(project,"linker_binary_override_c_cpp")),
     linker_binary_override_other(JSON::str_opt(project,"linker_binary_override_other")),
     linker_binary_override_all(JSON::str_opt(project,"linker_binary_override_all")),
-    noarch(JSON::bool_opt(project,"noarch",false))
+    noarch(JSON::bool_opt(project,"noarch",false)),
+    shared_objects(JSON::bool_opt(project,"shared_objects",false))
 {
     if(auto it=project.find("targets_default");it!=project.end()){
         if(it->second.is_str()){
             auto &s=it->second.get_str();
             if(s=="all"){
-                default_targets=Util::keys(targets.targets);
-            }else if(targets.targets.contains(s)||targets.target_groups.contains(s)){
+                default_targets=targets.names;
+            }else if(targets.contains(s)||targets.target_groups.contains(s)){
                 default_targets={s};
             }else{
                 warnings_out.push_back("Invalid Target in 'targets_default': "+Util::quote_str_single(s));
@@ -46,7 +56,7 @@ Project::Project(const JSON::object_t &project,std::vector<std::string> &warning
         }else if(it->second.is_arr()){
             default_targets=JSON::mkstrlist(it->second.get_arr());
             std::vector<std::string> invalid_targets;
-            std::tie(default_targets,invalid_targets)=Util::filter_inout(default_targets,Util::merge(Util::keys(targets.targets),Util::keys(targets.target_groups)));
+            std::tie(default_targets,invalid_targets)=Util::filter_inout(default_targets,Util::merge(targets.names,Util::keys(targets.target_groups)));
             if(invalid_targets.size()>0){
                 warnings_out.push_back("Invalid "+
                                        std::string(invalid_targets.size()==1?"Target":"Targets")+
@@ -57,7 +67,7 @@ Project::Project(const JSON::object_t &project,std::vector<std::string> &warning
             throw JSON::JSON_Exception("In 'targets_default': ",std::vector<std::string>{"String","Array"},it->second.type_name());
         }
     }else{
-        default_targets=Util::keys(targets.targets);
+        default_targets=targets.names;
     }
     static const std::string valid_keys[]{
         "targets",
@@ -74,6 +84,7 @@ Project::Project(const JSON::object_t &project,std::vector<std::string> &warning
         "compiler_asm",
         "linker",
         "noarch",
+        "shared_objects",
         "binary_folder_override",
         "compiler_binary_override_c",
         "compiler_binary_override_cpp",
@@ -92,12 +103,21 @@ Project::Project(const JSON::object_t &project,std::vector<std::string> &warning
     
 }
 
-static void gather_sources(std::vector<std::filesystem::path> & out,const std::filesystem::path &root,const std::vector<std::filesystem::path> &folders){
+// taken before listing 'folder', so that a source added while listing it still shows up as a change
+static void note_folder(std::vector<std::pair<std::filesystem::path,int64_t>> * listed_folders,const std::filesystem::path &folder){
+    if(!listed_folders)return;
+    std::error_code ec;
+    auto time=std::filesystem::last_write_time(folder,ec);
+    listed_folders->push_back({folder,ec?std::numeric_limits<int64_t>::min():int64_t(time.time_since_epoch().count())});
+}
+
+static void gather_sources(std::vector<std::filesystem::path> & out,const std::filesystem::path &root,const std::vector<std::filesystem::path> &folders,std::vector<std::pair<std::filesystem::path,int64_t>> * listed_folders){
     if(!std::filesystem::exists(root)) return;
     
     if(std::filesystem::is_directory(root)){
         for(const std::filesystem::path &folder:folders){
-            std::filesystem::path folder_root(root/folder);
+            const std::filesystem::path &folder_root=folder; // entries of a folder that was listed, which already start with 'root'
+            note_folder(listed_folders,folder_root);
             std::vector<std::filesystem::path> folder_folders;
             for(const std::filesystem::directory_entry &entry:std::filesystem::directory_iterator(folder_root)){
                 if(std::filesystem::is_regular_file(entry)){
@@ -106,32 +126,37 @@ static void gather_sources(std::vector<std::filesystem::path> & out,const std::f
                     folder_folders.push_back(entry);
                 }
             }
-            if(!folder_folders.empty())gather_sources(out,root,folder_folders);
+            if(!folder_folders.empty())gather_sources(out,root,folder_folders,listed_folders);
         }
     }else if(std::filesystem::is_regular_file(root)){
         out.push_back(root);
     }
 }
 
-static void gather_sources(std::vector<std::filesystem::path> & out,const std::filesystem::path &root,const std::vector<Targets::target::source_t> &folders){
+void gather_sources(std::vector<std::filesystem::path> & out,const std::filesystem::path &root,const std::vector<Targets::target::source_t> &folders,std::vector<std::pair<std::filesystem::path,int64_t>> * listed_folders){
     using source_type=Targets::target::source_type;
-    if(!std::filesystem::exists(root)) return;
+    if(!std::filesystem::exists(root)){
+        note_folder(listed_folders,root.parent_path());
+        return;
+    }
     
     if(std::filesystem::is_directory(root)){
         for(const Targets::target::source_t &folder:folders){
             std::filesystem::path folder_root(root/folder.name);
             if(std::filesystem::is_directory(folder_root)){
                 if(folder.type==source_type::WHITELIST){
-                    gather_sources(out,folder_root,folder.whitelist);
+                    gather_sources(out,folder_root,folder.whitelist,listed_folders);
                 }else if(folder.type==source_type::FOLDER_WHITELIST_FILE_BLACKLIST){
+                    note_folder(listed_folders,folder_root);
                     for(const std::filesystem::directory_entry &entry:std::filesystem::directory_iterator(folder_root)){
                         if(std::filesystem::is_regular_file(entry)){
                             if(Util::contains(folder.blacklist,entry.path().filename().string()))continue;
                             out.push_back(entry);
                         }
                     }
-                    gather_sources(out,folder_root,folder.whitelist);
+                    gather_sources(out,folder_root,folder.whitelist,listed_folders);
                 }else{
+                    note_folder(listed_folders,folder_root);
                     std::vector<std::filesystem::path> folder_folders;
                     for(const std::filesystem::directory_entry &entry:std::filesystem::directory_iterator(folder_root)){
                         if(Util::contains(folder.blacklist,entry.path().filename().string()))continue;
@@ -141,28 +166,32 @@ static void gather_sources(std::vector<std::filesystem::path> & out,const std::f
                             folder_folders.push_back(entry);
                         }
                     }
-                    if(!folder_folders.empty())gather_sources(out,root,folder_folders);
+                    if(!folder_folders.empty())gather_sources(out,root,folder_folders,listed_folders);
+                }
+            }else{
+                note_folder(listed_folders,folder_root.parent_path()); // for the file (or the folder) being removed or added
+                if(std::filesystem::is_regular_file(folder_root)){
+                    out.push_back(folder_root);
                 }
-            }else if(std::filesystem::is_regular_file(folder_root)){
-                out.push_back(folder_root);
             }
         }
     }else if(std::filesystem::is_regular_file(root)){
+        note_folder(listed_folders,root.parent_path());
         out.push_back(root);
     }
 }
 
 static std::filesystem::path get_obj_path(const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &src_file){
-    if(Util::is_subpath(src_base,src_file)){
-        return working_path/"obj"/(std::filesystem::relative(src_file,src_base).string()+".o");
+    if(auto rel=Util::subpath_relative(src_base,src_file)){
+        return working_path/"obj"/(rel->string()+".o");
     }else{
         throw std::runtime_error("source files outside src base directory not supported");
     }
 }
 
 //resolving link order is O(n*m) where n is number of objects to link and m is number of objects with specified link order
-static ssize_t get_link_order(Targets::target &target,const std::filesystem::path &out_base,const std::filesystem::path &out){
-    for(const Targets::target::link_order_t &lo_entry:target.linker_order){
+static ssize_t get_link_order(const std::vector<Targets::target::link_order_t> &linker_order,const std::filesystem::path &out_base,const std::filesystem::path &out){
+    for(const Targets::target::link_order_t &lo_entry:linker_order){
         if(lo_entry.type==Targets::target::LINK_NORMAL){
             if(out.filename().string()==lo_entry.name){
                 return lo_entry.weight;
@@ -177,6 +206,26 @@ static ssize_t get_link_order(Targets::target &target,const std::filesystem::pat
 }
 
 namespace {
+    struct job_t;
+    
+    // jobs handed to run_jobs while it is already running, from any thread
+    struct job_stream {
+        std::mutex mutex;
+        std::vector<job_t*> pending;
+        std::atomic<bool> closed=false; // no more jobs will be pushed
+        std::atomic<bool> stopped=false; // run_jobs has given up (a job failed), producers should stop
+        
+        void push(job_t * job){
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(job);
+        }
+        
+        std::vector<job_t*> take(){
+            std::lock_guard<std::mutex> lock(mutex);
+            return std::move(pending);
+        }
+    };
+    
     struct job_t {
         drivers::compiler::driver * driver;
         std::filesystem::path working_path;
@@ -187,8 +236,21 @@ namespace {
         Util::redirect_data output;
         std::atomic<bool> finished;
         std::atomic<bool> success;
+        bool scan=false; // scan the source for C++ modules into 'modules' instead of compiling it
+        bool rescan=false;
+        drivers::compiler::module_deps modules;
+        std::vector<job_t*> dependents; // jobs that can only start once this one succeeds
+        size_t pending_deps=0; // jobs this one is still waiting on
+        double seconds=0;
         static void run_job(job_t * data) try {
-            data->success=data->driver->compile(data->working_path,data->src_base,data->src,data->src_out,data->extra_args,&data->output);
+            if(data->scan){
+                data->modules=data->driver->scan_modules(data->working_path,data->src_base,data->src,data->src_out,data->rescan,&data->output);
+                data->success=true;
+            }else{
+                auto start=std::chrono::steady_clock::now();
+                data->success=data->driver->compile(data->working_path,data->src_base,data->src,data->src_out,data->extra_args,&data->output);
+                data->seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+            }
             data->output.stop();
             data->finished=true;
         } catch (std::exception &e) {
@@ -197,50 +259,59 @@ namespace {
             }catch (std::exception &e2){
                 data->output.s_stderr+="\nUnexpected Exception while stopping output thread: "+Util::quote_str_single(e2.what())+"\n";
             }
-            data->output.s_stderr+="\nUnexpected Exception while compiling: "+Util::quote_str_single(e.what())+"\n";
+            if(data->scan){
+                data->output.s_stderr+="\n"+std::string(e.what())+"\n";
+            }else{
+                data->output.s_stderr+="\nUnexpected Exception while compiling: "+Util::quote_str_single(e.what())+"\n";
+            }
             data->success=false;
             data->finished=true;
         }
-        static std::vector<std::unique_ptr<job_t>> run_jobs(std::queue<std::unique_ptr<job_t>> &jobs){
+        // runs 'jobs', and those pushed to 'stream' until it's closed, on up to num_jobs threads
+        // a job starts as soon as all the jobs it depends on have succeeded, in the order given otherwise
+        static std::vector<job_t*> run_jobs(const std::vector<std::unique_ptr<job_t>> &jobs,job_stream * stream=nullptr){
             bool ok=true;
-            std::unique_ptr<job_t> running_jobs_data[num_jobs];
-            std::thread running_jobs_thread[num_jobs];
+            size_t num_scheduled=jobs.size();
+            std::vector<job_t*> running_jobs_data(num_jobs,nullptr);
+            std::vector<std::thread> running_jobs_thread(num_jobs);
+            int running_count=0;
             
-            std::vector<std::unique_ptr<job_t>> finished_jobs;
+            std::queue<job_t*> ready;
+            for(const auto &job:jobs){
+                if(job->pending_deps==0)ready.push(job.get());
+            }
             
-            while(ok&&jobs.size()>0){
-                bool vacant_jobs=false;
-                int first_vacant=0;
-                int vacant_count=0;
+            std::vector<job_t*> finished_jobs;
+            
+            while(ok&&(stream||ready.size()>0||running_count>0)){
+                if(stream){
+                    bool closed=stream->closed;// read before taking, so that jobs pushed right before closing aren't missed
+                    for(job_t * job:stream->take()){
+                        ready.push(job);
+                        num_scheduled++;
+                    }
+                    if(closed&&ready.size()==0&&running_count==0)break;
+                }
                 for(int i=0;i<num_jobs;i++){
-                    if(running_jobs_data[i]){
-                        if(running_jobs_data[i]->finished){
-                            running_jobs_thread[i].join();
-                            if(!running_jobs_data[i]->success)ok=false;
-                            finished_jobs.emplace_back(std::move(running_jobs_data[i]));
-                            running_jobs_data[i]=nullptr;
-                            if(!vacant_jobs){
-                                first_vacant=i;
-                                vacant_jobs=true;
+                    if(running_jobs_data[i]&&running_jobs_data[i]->finished){
+                        running_jobs_thread[i].join();
+                        job_t * job=running_jobs_data[i];
+                        running_jobs_data[i]=nullptr;
+                        running_count--;
+                        finished_jobs.push_back(job);
+                        if(job->success){
+                            for(job_t * dependent:job->dependents){
+                                if(--dependent->pending_deps==0)ready.push(dependent);
                             }
-                            vacant_count++;
-                        }
-                    }else{
-                        if(!vacant_jobs){
-                            first_vacant=i;
-                            vacant_jobs=true;
+                        }else{
+                            ok=false;
                         }
-                        vacant_count++;
                     }
-                }
-                if(vacant_jobs&&ok){
-                    for(int i=first_vacant;i<num_jobs&&vacant_count>0&&jobs.size()>0;i++){
-                        if(!running_jobs_data[i]){
-                            running_jobs_data[i]=std::move(jobs.front());
-                            jobs.pop();
-                            running_jobs_thread[i]=std::thread(job_t::run_job,running_jobs_data[i].get());
-                            vacant_count--;
-                        }
+                    if(!running_jobs_data[i]&&ok&&ready.size()>0){
+                        running_jobs_data[i]=ready.front();
+                        ready.pop();
+                        running_count++;
+                        running_jobs_thread[i]=std::thread(job_t::run_job,running_jobs_data[i]);
                     }
                 }
                 std::this_thread::yield();
@@ -250,13 +321,115 @@ namespace {
                 if(running_jobs_data[i]){
                     running_jobs_thread[i].join();
                     if(!running_jobs_data[i]->success)ok=false;
-                    finished_jobs.emplace_back(std::move(running_jobs_data[i]));
+                    finished_jobs.push_back(running_jobs_data[i]);
                     running_jobs_data[i]=nullptr;
                 }
             }
+            if(stream){
+                stream->stopped=true;
+            }
+            if(ok&&finished_jobs.size()<num_scheduled){
+                throw std::runtime_error("Circular dependency between compile jobs");
+            }
             return finished_jobs;
         }
     };
+    
+    struct module_graph {
+        std::vector<std::filesystem::path> order; // sources sorted so that module interfaces come before the sources importing them
+        std::map<std::filesystem::path,drivers::compiler::module_deps> deps;
+        std::map<std::filesystem::path,std::vector<std::filesystem::path>> providers; // sources providing the modules each source imports
+        std::map<std::filesystem::path,bool> dirty; // needs_compile, including a rebuild of any module it imports
+    };
+}
+
+static module_graph scan_modules(drivers::compiler::driver * driver,const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::vector<std::filesystem::path> &sources){
+    using std::filesystem::path;
+    module_graph graph;
+    for(const path &src:sources){
+        graph.dirty[src]=driver->needs_compile(working_path,src_base,src,get_obj_path(working_path,src_base,src));
+    }
+    
+    if(num_jobs>0){
+        std::vector<std::unique_ptr<job_t>> jobs;
+        for(const path &src:sources){
+            jobs.push_back(std::make_unique<job_t>(driver,working_path,src_base,src,get_obj_path(working_path,src_base,src),std::vector<std::string>{},Util::redirect_data{},false,false,true,graph.dirty[src]));
+        }
+        std::vector<std::string> failed_files;
+        for(job_t * job:job_t::run_jobs(jobs)){
+            if(!job->output.s_stderr.empty()){
+                std::cerr<<job->output.s_stdout<<job->output.s_stderr<<"\n";
+            }
+            if(job->success){
+                graph.deps[job->src]=std::move(job->modules);
+            }else{
+                failed_files.push_back(Util::quote_str_single(std::filesystem::relative(job->src,job->src_base).string()));
+            }
+        }
+        if(failed_files.size()>0){
+            throw std::runtime_error("Failed to scan "+Util::join(failed_files,", "));
+        }
+    }else{
+        for(const path &src:sources){
+            graph.deps[src]=driver->scan_modules(working_path,src_base,src,get_obj_path(working_path,src_base,src),graph.dirty[src],nullptr);
+        }
+    }
+    
+    std::map<std::string,path> provided_by;
+    for(const path &src:sources){
+        for(const std::string &name:graph.deps[src].provides){
+            if(auto [it,inserted]=provided_by.insert({name,src});!inserted){
+                throw std::runtime_error("Module "+Util::quote_str_single(name)+" provided by both "+Util::quote_str_single(std::filesystem::relative(it->second).string())+" and "+Util::quote_str_single(std::filesystem::relative(src).string()));
+            }
+        }
+    }
+    
+    std::map<path,std::vector<path>> importers;
+    std::map<path,size_t> pending;
+    for(const path &src:sources){
+        auto &providers=graph.providers[src];
+        for(const std::string &name:graph.deps[src].imports){
+            // modules not provided by the target (standard library, header units, ...) are left to the compiler
+            if(auto it=provided_by.find(name);it!=provided_by.end()&&it->second!=src&&!Util::contains(providers,it->second)){
+                providers.push_back(it->second);
+                importers[it->second].push_back(src);
+            }
+        }
+        pending[src]=providers.size();
+    }
+    
+    std::queue<path> ready;
+    for(const path &src:sources){
+        if(pending[src]==0)ready.push(src);
+    }
+    while(ready.size()>0){
+        path src=ready.front();
+        ready.pop();
+        graph.order.push_back(src);
+        for(const path &importer:importers[src]){
+            if(--pending[importer]==0)ready.push(importer);
+        }
+    }
+    if(graph.order.size()<sources.size()){
+        std::vector<std::string> cycle;
+        for(const path &src:sources){
+            if(pending[src]>0)cycle.push_back(Util::quote_str_single(std::filesystem::relative(src).string()));
+        }
+        throw std::runtime_error("Circular module dependency between "+Util::join(cycle,", "));
+    }
+    
+    driver->prepare_modules(working_path,Util::keys(provided_by));
+    
+    for(const path &src:graph.order){
+        bool &dirty=graph.dirty[src];
+        for(const std::string &name:graph.deps[src].provides){
+            dirty=dirty||!std::filesystem::exists(driver->get_bmi(working_path,name));
+        }
+        for(const path &provider:graph.providers[src]){
+            dirty=dirty||graph.dirty[provider];
+        }
+    }
+    return graph;
 }
 
 static const char * arch_folder(
@@ -272,10 +445,14 @@ static const char * arch_folder(
 #endif
 );
 
-static std::filesystem::path get_working_path(Targets::target &target,bool noarch,std::filesystem::path working_folder,std::string target_name){
+static std::filesystem::path get_working_path(const Targets::target &target,bool noarch,std::filesystem::path working_folder,std::string target_name){
     return (noarch?working_folder:(working_folder/arch_folder))/(target.target_folder_override?*target.target_folder_override:target_name);
 }
 
+static std::filesystem::path get_shared_path(bool noarch,std::filesystem::path working_folder,const std::string &signature){
+    return (noarch?working_folder:(working_folder/arch_folder))/".objects"/Util::sha256(signature).substr(0,16); // same name whichever standard library RBuild was built with
+}
+
 
 std::vector<std::string> Project::resolve_target_groups(const std::vector<std::string> &target_names){
     std::unordered_set<std::string> target_group_memory;
@@ -303,28 +480,177 @@ std::vector<std::string> Project::resolve_target_groups(const std::vector<std::s
     return out;
 }
 
+void Project::load_targets(const std::vector<std::string> &target_names,std::vector<std::string> &warnings_out){
+    targets.load(resolve_target_groups(target_names),warnings_out);
+}
+
+// compile, recording how long it took for the deps index
+static bool timed_compile(drivers::compiler::driver * driver,const std::filesystem::path &working_path,const std::filesystem::path &src_base,const std::filesystem::path &src,const std::vector<std::string> &extra_args,std::map<std::filesystem::path,double> &compile_seconds){
+    auto start=std::chrono::steady_clock::now();
+    if(!driver->compile(working_path,src_base,src,get_obj_path(working_path,src_base,src),extra_args,nullptr))return false;
+    compile_seconds[src]=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    return true;
+}
+
+static std::filesystem::path get_deps_index_path(const std::filesystem::path &working_path){
+    return working_path/"tmp"/"deps.index";
+}
+
+// every shared_objects store the target compiled into, so that -clean can remove them
+static std::filesystem::path get_shared_stores_path(const std::filesystem::path &working_path){
+    return working_path/"tmp"/"shared.stores";
+}
+
+static std::vector<std::string> read_shared_stores(const std::filesystem::path &working_path){
+    const std::filesystem::path file=get_shared_stores_path(working_path);
+    return std::filesystem::exists(file)?Util::split(Util::readfile(file.string()),'\n'):std::vector<std::string>{};
+}
+
+static void add_shared_stores(const std::filesystem::path &working_path,const std::vector<std::filesystem::path> &stores){
+    std::vector<std::string> known=read_shared_stores(working_path);
+    bool changed=false;
+    for(const std::filesystem::path &store:stores){
+        if(!Util::contains(known,store.string())){
+            known.push_back(store.string());
+            changed=true;
+        }
+    }
+    if(changed){
+        std::filesystem::create_directories(working_path/"tmp");
+        Util::writefile(get_shared_stores_path(working_path).string(),Util::join(known,"\n"));
+    }
+}
+
+static std::filesystem::path get_output_hashes_path(const std::filesystem::path &working_path){
+    return working_path/"tmp"/"outputs.hash";
+}
+
+// delete the files in 'files' that exist, and the folders under 'working_path' that deleting them left empty
+static void remove_outputs(const std::vector<std::filesystem::path> &files,const std::filesystem::path &working_path){
+    std::error_code ec;
+    for(const std::filesystem::path &file:files){
+        if(std::filesystem::remove(file,ec)){
+            for(std::filesystem::path dir=file.parent_path();dir!=working_path&&dir.has_relative_path()&&std::filesystem::remove(dir,ec);dir=dir.parent_path());
+        }
+    }
+}
+
+// -explain/-dry_run, only report which sources would be recompiled and why
+static bool is_dry_run(){
+    static bool dry_run=Args::has_flag("explain")||Args::has_flag("dry_run");
+    return dry_run;
+}
+
+// -shard=i/N, compile only the i-th of N parts of every target and don't link, for spreading a build over N machines
+struct shard_t {
+    size_t index; // 0-based
+    size_t count;
+};
+
+static std::optional<shard_t> get_shard(){
+    static const std::optional<shard_t> shard=[]() -> std::optional<shard_t> {
+        if(!Args::named.contains("shard"))return std::nullopt;
+        const std::string arg=Args::namedArg("shard");
+        std::vector<std::string> parts=Util::split(arg,'/');
+        size_t i=0,n=0;
+        try{
+            if(parts.size()==2){
+                i=std::stoul(parts[0]);
+                n=std::stoul(parts[1]);
+            }
+        }catch(std::exception &e){
+            n=0;
+        }
+        if(n==0||i<1||i>n){
+            throw std::runtime_error("Invalid shard "+Util::quote_str_single(arg)+", expected 'i/N' with 1 <= i <= N");
+        }
+        if(Args::has_flag("link_only")){
+            throw std::runtime_error("-shard and -link_only can't be used together");
+        }
+        return shard_t{i-1,n};
+    }();
+    return shard;
+}
+
+// -link_only, link the objects compiled by -shard runs without compiling anything
+static bool is_link_only(){
+    static bool link_only=Args::has_flag("link_only");
+    return link_only;
+}
+
+// FNV-1a, unlike std::hash the same on every platform and standard library
+static uint64_t stable_hash(const std::string &s){
+    uint64_t h=14695981039346656037ULL;
+    for(unsigned char c:s){
+        h=(h^c)*1099511628211ULL;
+    }
+    return h;
+}
+
+// the sources of 'shard', from splitting 'sources' into shards with about the same number of sources each:
+// sorted by the hash of their project relative path, then dealt out in turn, so the split only depends on the sources
+// and every machine computes the same one (compile times would differ between the machines' deps indexes)
+static std::unordered_set<std::string> shard_sources(const std::vector<std::filesystem::path> &sources,shard_t shard){
+    std::vector<std::pair<uint64_t,std::string>> entries;
+    for(const std::filesystem::path &src:sources){
+        std::string file=Util::project_relative(src).generic_string();
+        entries.push_back({stable_hash(file),std::move(file)});
+    }
+    std::sort(entries.begin(),entries.end());
+    
+    std::unordered_set<std::string> out;
+    for(size_t i=shard.index;i<entries.size();i+=shard.count){
+        out.insert(entries[i].second);
+    }
+    return out;
+}
+
+static void print_explain_summary(size_t num_recompiled,size_t num_sources,const std::map<std::string,size_t> &changed){
+    static constexpr size_t max_shown=20;
+    std::cout<<"\n"<<num_recompiled<<" of "<<num_sources<<" sources would be recompiled\n";
+    if(changed.size()>0){
+        std::vector<std::pair<std::string,size_t>> sorted(changed.begin(),changed.end());
+        std::stable_sort(sorted.begin(),sorted.end(),[](const auto &a,const auto &b){return a.second>b.second;});
+        std::cout<<"\nDependencies causing the most recompiles:\n";
+        for(size_t i=0;i<sorted.size()&&i<max_shown;i++){
+            char count[32];
+            snprintf(count,sizeof(count),"%8zu  ",sorted[i].second);
+            std::cout<<count<<sorted[i].first<<"\n";
+        }
+        if(sorted.size()>max_shown){
+            std::cout<<"     ...  "<<(sorted.size()-max_shown)<<" more\n";
+        }
+    }
+}
+
+static std::filesystem::path get_toolchain_cache_path(bool noarch,std::filesystem::path working_folder){
+    return (noarch?working_folder:(working_folder/arch_folder))/"toolchains.cache";
+}
+
 bool Project::build_targets(const std::vector<std::string> &target_names,bool failexit){
     std::vector<std::string> ts(resolve_target_groups(target_names));
+    Toolchain::cache_file=get_toolchain_cache_path(noarch,working_folder);
     bool fail=false;
     for(const std::string &t:ts){
-        std::cout<<"----------------\nBuilding target "<<Util::quote_str_single(t)<<(name?(" in "+Util::quote_str_single(*name)):"")<<"\n----------------\n";
+        std::cout<<"----------------\n"<<(is_dry_run()?"Checking":"Building")<<" target "<<Util::quote_str_single(t)<<(name?(" in "+Util::quote_str_single(*name)):"")<<"\n----------------\n";
         try{
             if(build_target(t)){
-                std::cout<<"\n\nBuilt target "<<Util::quote_str_single(t)<<" successfully!\n\n\n";
+                std::cout<<"\n\n"<<(is_dry_run()?"Checked":"Built")<<" target "<<Util::quote_str_single(t)<<" successfully!\n\n\n";
             }else{
                 std::cout<<"\n\nBuilding target "<<Util::quote_str_single(t)<<" failed!\n\n\n";
-                if(failexit){
-                    return false;
-                }
                 fail=true;
             }
         }catch(std::exception &e){
             std::cout<<"\n\nBuilding target "<<Util::quote_str_single(t)<<" failed: "<<e.what()<<"!\n\n\n";
-            if(failexit){
-                return false;
-            }
             fail=true;
         }
+        if(fail&&failexit){
+            break;
+        }
+    }
+    if(!is_dry_run()){ // -explain/-dry_run leave the working folder untouched
+        save_plans();
+        Toolchain::save();
     }
     return !fail;
 }
@@ -347,96 +673,191 @@ bool Project::clean_targets(const std::vector<std::string> &target_names,bool fa
     return !fail;
 }
 
+static std::filesystem::path get_plan_cache_path(bool noarch,std::filesystem::path working_folder){
+    return (noarch?working_folder:(working_folder/arch_folder))/"plan.cache";
+}
+
+TargetPlan Project::make_plan(const std::string &target_name){
+    using std::filesystem::path;
+    
+    auto &target=targets.at(target_name);
+    
+    TargetPlan plan;
+    
+    plan.compiler_c={
+        .driver=target.compiler_driver_override_c?*target.compiler_driver_override_c
+               :target.compiler_driver_override_c_cpp?*target.compiler_driver_override_c_cpp
+               :target.compiler_driver_override_all?*target.compiler_driver_override_all
+               :compiler_c?*compiler_c
+               :compiler_c_cpp?*compiler_c_cpp
+               :compiler_all?*compiler_all
+               :"gcc",
+        .flags=Util::merge(target.flags_all,target.flags_c_cpp,target.flags_c),
+        .defines=Util::merge(target.defines_all,target.defines_c_cpp,target.defines_c),
+        .binary=target.compiler_binary_override_c?target.compiler_binary_override_c
+               :target.compiler_binary_override_c_cpp?target.compiler_binary_override_c_cpp
+               :target.compiler_binary_override_all?target.compiler_binary_override_all
+               :compiler_binary_override_c?compiler_binary_override_c
+               :compiler_binary_override_c_cpp?compiler_binary_override_c_cpp
+               :compiler_binary_override_all?compiler_binary_override_all
+               :std::nullopt,
+    };
+    
+    plan.compiler_cpp={
+        .driver=target.compiler_driver_override_cpp?*target.compiler_driver_override_cpp
+               :target.compiler_driver_override_c_cpp?*target.compiler_driver_override_c_cpp
+               :target.compiler_driver_override_all?*target.compiler_driver_override_all
+               :compiler_cpp?*compiler_cpp
+               :compiler_c_cpp?*compiler_c_cpp
+               :compiler_all?*compiler_all
+               :"gcc",
+        .flags=Util::merge(target.flags_all,target.flags_c_cpp,target.flags_cpp),
+        .defines=Util::merge(target.defines_all,target.defines_c_cpp,target.defines_cpp),
+        .binary=target.compiler_binary_override_cpp?target.compiler_binary_override_cpp
+               :target.compiler_binary_override_c_cpp?target.compiler_binary_override_c_cpp
+               :target.compiler_binary_override_all?target.compiler_binary_override_all
+               :compiler_binary_override_cpp?compiler_binary_override_cpp
+               :compiler_binary_override_c_cpp?compiler_binary_override_c_cpp
+               :compiler_binary_override_all?compiler_binary_override_all
+               :std::nullopt,
+    };
+    
+    plan.compiler_asm={
+        .driver=target.compiler_driver_override_asm?*target.compiler_driver_override_asm
+               :target.compiler_driver_override_all?*target.compiler_driver_override_all
+               :compiler_asm?*compiler_asm
+               :compiler_all?*compiler_all
+               :"gcc",
+        .flags=Util::merge(target.flags_all,target.flags_asm),
+        .defines=Util::merge(target.defines_all,target.defines_asm),
+        .binary=target.compiler_binary_override_asm?target.compiler_binary_override_asm
+               :target.compiler_binary_override_all?target.compiler_binary_override_all
+               :compiler_binary_override_asm?compiler_binary_override_asm
+               :compiler_binary_override_all?compiler_binary_override_all
+               :std::nullopt,
+    };
+    
+    plan.linker=target.linker_driver_override?*target.linker_driver_override
+               :linker?*linker
+               :"gcc";
+    plan.linker_flags=target.linker_flags;
+    plan.linker_libs=target.linker_libs;
+    plan.linker_binary_c=target.linker_binary_override_c?target.linker_binary_override_c
+                        :target.linker_binary_override_c_cpp?target.linker_binary_override_c_cpp
+                        :target.linker_binary_override_all?target.linker_binary_override_all
+                        :linker_binary_override_c?linker_binary_override_c
+                        :linker_binary_override_c_cpp?linker_binary_override_c_cpp
+                        :linker_binary_override_all?linker_binary_override_all
+                        :std::nullopt;
+    plan.linker_binary_cpp=target.linker_binary_override_cpp?target.linker_binary_override_cpp
+                          :target.linker_binary_override_c_cpp?target.linker_binary_override_c_cpp
+                          :target.linker_binary_override_all?target.linker_binary_override_all
+                          :linker_binary_override_cpp?linker_binary_override_cpp
+                          :linker_binary_override_c_cpp?linker_binary_override_c_cpp
+                          :linker_binary_override_all?linker_binary_override_all
+                          :std::nullopt;
+    plan.linker_binary_other=target.linker_binary_override_other?target.linker_binary_override_other
+                            :target.linker_binary_override_all?target.linker_binary_override_all
+                            :linker_binary_override_other?linker_binary_override_other
+                            :linker_binary_override_all?linker_binary_override_all
+                            :std::nullopt;
+    plan.linker_ar_incremental=target.linker_ar_incremental.value_or(false);
+    plan.linker_ar_thin=target.linker_ar_thin.value_or(false);
+    plan.linker_backend=target.linker_backend.value_or("default");
+    plan.linker_order=target.linker_order;
+    
+    plan.split_dwarf=target.split_dwarf.value_or(false);
+    plan.split_dwarf_dwp=target.split_dwarf_dwp.value_or(false);
+    plan.lto=target.lto.value_or("off");
+    plan.generic_dep_flags=target.generic_dep_flags;
+    plan.generic_dep_format=target.generic_dep_format.value_or("make");
+    plan.cpp_modules=target.cpp_modules.value_or(false);
+    
+    plan.src_base=src_path.empty()?std::filesystem::current_path():path(src_path);
+    plan.working_path=get_working_path(target,noarch,working_folder,target_name);
+    plan.binary_folder=target.binary_folder_override?path(*target.binary_folder_override):(binary_folder_override?path(*binary_folder_override):(plan.working_path/"bin"));
+    plan.binary_name=target.project_binary_override?*target.project_binary_override:project_binary;
+    plan.binary_ext=project_ext;
+    
+    gather_sources(plan.sources,plan.src_base,target.sources,&plan.folders);
+    // parent folders of listed files come up once per file, keep the earliest time of each
+    std::stable_sort(plan.folders.begin(),plan.folders.end(),[](const auto &a,const auto &b){return a.first<b.first;});
+    plan.folders.erase(std::unique(plan.folders.begin(),plan.folders.end(),[](const auto &a,const auto &b){return a.first==b.first;}),plan.folders.end());
+    
+    return plan;
+}
+
+const TargetPlan& Project::get_plan(const std::string &target_name){
+    if(!plan_cache_read&&!plan_key.empty()){
+        plan_cache=PlanCache::read(get_plan_cache_path(noarch,working_folder),plan_key);
+    }
+    plan_cache_read=true;
+    if(auto it=plan_cache.plans.find(target_name);it!=plan_cache.plans.end()&&it->second.sources_up_to_date()){
+        return it->second;
+    }
+    TargetPlan plan=make_plan(target_name);
+    plan_cache.changed=true;
+    return plan_cache.plans.insert_or_assign(target_name,std::move(plan)).first->second;
+}
+
+void Project::save_plans(){
+    if(!plan_key.empty()&&plan_cache.changed){
+        plan_cache.write(get_plan_cache_path(noarch,working_folder));
+        plan_cache.changed=false;
+    }
+}
+
 bool Project::build_target(const std::string & target_name) try{
     using std::filesystem::path;
     
-    auto &target=targets.targets.at(target_name);
+    const TargetPlan &plan=get_plan(target_name);
     
     using namespace drivers;
     
-    std::unique_ptr<compiler::driver> c_compiler_driver(drivers::get_compiler(target.compiler_driver_override_c?*target.compiler_driver_override_c
-                                                                             :target.compiler_driver_override_c_cpp?*target.compiler_driver_override_c_cpp
-                                                                             :target.compiler_driver_override_all?*target.compiler_driver_override_all
-                                                                             :compiler_c?*compiler_c
-                                                                             :compiler_c_cpp?*compiler_c_cpp
-                                                                             :compiler_all?*compiler_all
-                                                                             :"gcc"
-                                                                             ,drivers::LANG_C
-                                                                             ,Util::merge(target.flags_all,target.flags_c_cpp,target.flags_c)
-                                                                             ,Util::merge(target.defines_all,target.defines_c_cpp,target.defines_c)
-                                                                             ,target.compiler_binary_override_c?target.compiler_binary_override_c
-                                                                             :target.compiler_binary_override_c_cpp?target.compiler_binary_override_c_cpp
-                                                                             :target.compiler_binary_override_all?target.compiler_binary_override_all
-                                                                             :compiler_binary_override_c?compiler_binary_override_c
-                                                                             :compiler_binary_override_c_cpp?compiler_binary_override_c_cpp
-                                                                             :compiler_binary_override_all?compiler_binary_override_all
-                                                                             :std::nullopt
-                                                                             ));
-    
-    std::unique_ptr<compiler::driver> cpp_compiler_driver(drivers::get_compiler(target.compiler_driver_override_cpp?*target.compiler_driver_override_cpp
-                                                                               :target.compiler_driver_override_c_cpp?*target.compiler_driver_override_c_cpp
-                                                                               :target.compiler_driver_override_all?*target.compiler_driver_override_all
-                                                                               :compiler_cpp?*compiler_cpp
-                                                                               :compiler_c_cpp?*compiler_c_cpp
-                                                                               :compiler_all?*compiler_all
-                                                                               :"gcc"
-                                                                               ,drivers::LANG_CPP
-                                                                               ,Util::merge(target.flags_all,target.flags_c_cpp,target.flags_cpp)
-                                                                               ,Util::merge(target.defines_all,target.defines_c_cpp,target.defines_cpp)
-                                                                               ,target.compiler_binary_override_cpp?target.compiler_binary_override_cpp
-                                                                               :target.compiler_binary_override_c_cpp?target.compiler_binary_override_c_cpp
-                                                                               :target.compiler_binary_override_all?target.compiler_binary_override_all
-                                                                               :compiler_binary_override_cpp?compiler_binary_override_cpp
-                                                                               :compiler_binary_override_c_cpp?compiler_binary_override_c_cpp
-                                                                               :compiler_binary_override_all?compiler_binary_override_all
-                                                                               :std::nullopt
-                                                                               ));
-    
-    std::unique_ptr<compiler::driver> asm_compiler_driver(drivers::get_compiler(target.compiler_driver_override_asm?*target.compiler_driver_override_asm
-                                                                               :target.compiler_driver_override_all?*target.compiler_driver_override_all
-                                                                               :compiler_asm?*compiler_asm
-                                                                               :compiler_all?*compiler_all
-                                                                               :"gcc"
-                                                                               ,drivers::LANG_ASM
-                                                                               ,Util::merge(target.flags_all,target.flags_asm)
-                                                                               ,Util::merge(target.defines_all,target.defines_asm)
-                                                                               ,target.compiler_binary_override_asm?target.compiler_binary_override_asm
-                                                                               :target.compiler_binary_override_all?target.compiler_binary_override_all
-                                                                               :compiler_binary_override_asm?compiler_binary_override_asm
-                                                                               :compiler_binary_override_all?compiler_binary_override_all
-                                                                               :std::nullopt
-                                                                               ));
-    
-    std::unique_ptr<linker::driver> linker_driver(drivers::get_linker(target.linker_driver_override?*target.linker_driver_override
-                                                                     :linker?*linker
-                                                                     :"gcc"
-                                                                     ,target.linker_flags,target.linker_libs
-                                                                     ,target.linker_binary_override_c?target.linker_binary_override_c
-                                                                     :target.linker_binary_override_c_cpp?target.linker_binary_override_c_cpp
-                                                                     :target.linker_binary_override_all?target.linker_binary_override_all
-                                                                     :linker_binary_override_c?linker_binary_override_c
-                                                                     :linker_binary_override_c_cpp?linker_binary_override_c_cpp
-                                                                     :linker_binary_override_all?linker_binary_override_all
-                                                                     :std::nullopt
-                                                                     ,target.linker_binary_override_cpp?target.linker_binary_override_cpp
-                                                                     :target.linker_binary_override_c_cpp?target.linker_binary_override_c_cpp
-                                                                     :target.linker_binary_override_all?target.linker_binary_override_all
-                                                                     :linker_binary_override_cpp?linker_binary_override_cpp
-                                                                     :linker_binary_override_c_cpp?linker_binary_override_c_cpp
-                                                                     :linker_binary_override_all?linker_binary_override_all
-                                                                     :std::nullopt
-                                                                     ,target.linker_binary_override_other?target.linker_binary_override_other
-                                                                     :target.linker_binary_override_all?target.linker_binary_override_all
-                                                                     :linker_binary_override_other?linker_binary_override_other
-                                                                     :linker_binary_override_all?linker_binary_override_all
-                                                                     :std::nullopt
+    const lto_mode lto=(plan.lto=="off")?LTO_OFF:(plan.lto=="thin")?LTO_THIN:LTO_FULL;
+    
+    const compiler::options c_cpp_compiler_options{
+        .split_dwarf=plan.split_dwarf,
+        .lto=lto,
+        .dep_flags=plan.generic_dep_flags,
+        .dep_format=plan.generic_dep_format,
+    };
+    
+    const compiler::options asm_compiler_options{
+        .dep_flags=plan.generic_dep_flags,
+        .dep_format=plan.generic_dep_format,
+    };
+    
+    std::unique_ptr<compiler::driver> c_compiler_driver(drivers::get_compiler(plan.compiler_c.driver,drivers::LANG_C,plan.compiler_c.flags,plan.compiler_c.defines,plan.compiler_c.binary,c_cpp_compiler_options));
+    std::unique_ptr<compiler::driver> cpp_compiler_driver(drivers::get_compiler(plan.compiler_cpp.driver,drivers::LANG_CPP,plan.compiler_cpp.flags,plan.compiler_cpp.defines,plan.compiler_cpp.binary,c_cpp_compiler_options));
+    std::unique_ptr<compiler::driver> asm_compiler_driver(drivers::get_compiler(plan.compiler_asm.driver,drivers::LANG_ASM,plan.compiler_asm.flags,plan.compiler_asm.defines,plan.compiler_asm.binary,asm_compiler_options));
+    
+    std::unique_ptr<linker::driver> linker_driver(drivers::get_linker(plan.linker,plan.linker_flags,plan.linker_libs
+                                                                     ,plan.linker_binary_c,plan.linker_binary_cpp,plan.linker_binary_other
+                                                                     ,{
+                                                                         .ar_incremental=plan.linker_ar_incremental,
+                                                                         .ar_thin=plan.linker_ar_thin,
+                                                                         .backend=plan.linker_backend,
+                                                                         .threads=num_jobs,
+                                                                         .dwp=plan.split_dwarf&&plan.split_dwarf_dwp,
+                                                                         .lto=lto,
+                                                                     }
                                                                      ));
     
-    path src_base=src_path.empty()?std::filesystem::current_path():path(src_path);
-    path working_path=get_working_path(target,noarch,working_folder,target_name);
-    path out_base=working_path/"obj";
-    std::vector<path> sources_all;
-    gather_sources(sources_all,src_base,target.sources);
+    const path &src_base=plan.src_base;
+    const path &working_path=plan.working_path;
+    
+    // with shared_objects, every compiler compiles into a store keyed by its signature and the fingerprint of its binary, so targets compiling the same sources the same way share objects, and a changed compiler starts a new store
+    auto shared_path=[this](compiler::driver * driver){
+        return get_shared_path(noarch,working_folder,driver->get_signature()+"\n"+driver->get_fingerprint().id());
+    };
+    const path c_working_path=shared_objects?shared_path(c_compiler_driver.get()):working_path;
+    const path cpp_working_path=shared_objects?shared_path(cpp_compiler_driver.get()):working_path;
+    const path asm_working_path=shared_objects?shared_path(asm_compiler_driver.get()):working_path;
+    if(shared_objects&&!is_dry_run()){
+        add_shared_stores(working_path,{c_working_path,cpp_working_path,asm_working_path});
+    }
+    const std::vector<path> &sources_all=plan.sources;
     
     static const std::string c_extensions[]{
         ".c",
@@ -447,6 +868,7 @@ bool Project::build_target(const std::string & target_name) try{
         ".c++",
         ".cxx",
         ".cc",
+        ".cppm", // C++20 module interface units, clang only
         #if defined(__linux__)
         ".C",
         #endif // defined
@@ -464,7 +886,7 @@ bool Project::build_target(const std::string & target_name) try{
         std::vector<path> sources_asm(FILTER_EXTENSIONS(asm_extensions));
     #undef FILTER_EXTENSIONS
     
-    for(const Targets::target::link_order_t &lo_entry:target.linker_order){
+    for(const Targets::target::link_order_t &lo_entry:plan.linker_order){
         if(lo_entry.type==Targets::target::LINK_EXTRA){
             linker_driver->add_file(lo_entry.weight,lo_entry.name);
         }
@@ -472,17 +894,105 @@ bool Project::build_target(const std::string & target_name) try{
     
     std::cout<<"\n";
     
-    if(num_jobs>0){
-        std::queue<std::unique_ptr<job_t>> jobs;
+    const bool cpp_modules=plan.cpp_modules&&sources_cpp.size()>0;
+    
+    // read before compiling to find the sources removed since the last build
+    const path deps_index_file=get_deps_index_path(working_path);
+    std::optional<DepsIndex> old_index=DepsIndex::read(deps_index_file);
+    
+    std::unordered_set<std::string> in_shard;
+    if(get_shard()&&!is_dry_run()){
+        if(cpp_modules){
+            throw std::runtime_error("-shard doesn't support targets with cpp_modules, sources need the compiled interfaces of the modules they import");
+        }
+        in_shard=shard_sources(Util::merge(sources_c,sources_cpp,sources_asm),*get_shard());
+    }
+    auto skip_source=[&in_shard](const path &src){
+        return get_shard()&&!in_shard.contains(Util::project_relative(src).generic_string());
+    };
+    
+    // with jobs, up-to-date checks run on a pool and stream dirty sources into the job scheduler instead,
+    // except for module sources, which need every check done to build their dependency graph
+    #define PREFETCH(lang) PP_JOIN(lang,_compiler_driver)->prefetch(PP_JOIN(lang,_working_path),src_base,Util::map(PP_JOIN(sources_,lang),[&](const path &src){return std::pair<path,path>(src,get_obj_path(PP_JOIN(lang,_working_path),src_base,src));}))
+        if(num_jobs==0||is_dry_run()){
+            PREFETCH(c);
+            PREFETCH(cpp);
+            PREFETCH(asm);
+        }else if(cpp_modules){
+            PREFETCH(cpp);
+        }
+    #undef PREFETCH
+    
+    module_graph modules;
+    
+    if(is_dry_run()){
+        // module sources would need scanning, which runs the compiler, so rebuilds of imported modules aren't explained
+        size_t num_recompiled=0;
+        std::map<std::string,size_t> changed;
+        
+        #define EXPLAIN(lang)\
+            for(const auto & src : PP_JOIN(sources_,lang) ){\
+                compiler::explanation why=PP_JOIN(lang,_compiler_driver)->explain(PP_JOIN(lang,_working_path),src_base,src,get_obj_path(PP_JOIN(lang,_working_path),src_base,src));\
+                if(!why.reason.empty()){\
+                    std::cout<<std::filesystem::relative(src).string()<<": "<<why.reason<<"\n";\
+                    num_recompiled++;\
+                }\
+                for(const std::string &dep:why.changed){\
+                    changed[dep]++;\
+                }\
+            }
+        
+        EXPLAIN(c);
+        EXPLAIN(cpp);
+        EXPLAIN(asm);
+        
+        #undef EXPLAIN
+        
+        print_explain_summary(num_recompiled,sources_c.size()+sources_cpp.size()+sources_asm.size(),changed);
+        return true;
+    }
+    
+    if(cpp_modules&&!is_link_only()){
+        modules=scan_modules(cpp_compiler_driver.get(),cpp_working_path,src_base,sources_cpp);
+    }
+    
+    std::map<path,double> compile_seconds; // of the sources compiled by this build
+    
+    if(is_link_only()){
+        std::vector<std::string> missing;
+        
+        #define LINK_ONLY(lang)\
+            for(const auto & src : PP_JOIN(sources_,lang) ){\
+                path src_out (get_obj_path(PP_JOIN(lang,_working_path),src_base,src));\
+                if(!std::filesystem::exists(src_out)){\
+                    missing.push_back(Util::quote_str_single(std::filesystem::relative(src_out).string()));\
+                }\
+                linker_driver->add_file(get_link_order(plan.linker_order,PP_JOIN(lang,_working_path)/"obj",src_out),src_out);\
+            }
+        
+        LINK_ONLY(c);
+        LINK_ONLY(cpp);
+        LINK_ONLY(asm);
+        
+        #undef LINK_ONLY
+        
+        if(missing.size()>0){
+            static constexpr size_t max_shown=10;
+            const size_t num_missing=missing.size();
+            if(num_missing>max_shown)missing.resize(max_shown);
+            throw std::runtime_error(std::to_string(num_missing)+" missing object"+(num_missing==1?"":"s")+" for -link_only, "+Util::join(missing,", ")+(num_missing>max_shown?", ...":""));
+        }
+    }else if(num_jobs>0){
+        std::vector<std::unique_ptr<job_t>> jobs;
+        std::vector<std::unique_ptr<job_t>> unchecked_jobs; // one per source, pushed to the scheduler by the checkers if needs_compile
         
         #define COMPILE_JOB(lang)\
             for(const auto & src : PP_JOIN(sources_,lang) ){\
-                path src_out (get_obj_path(working_path,src_base,src));\
-                bool needs_compile=PP_JOIN(lang,_compiler_driver)->needs_compile(working_path,src_base,src,src_out);\
-                if(needs_compile){\
-                    jobs.push(std::make_unique<job_t>(\
+                path src_out (get_obj_path(PP_JOIN(lang,_working_path),src_base,src));\
+                if(!skip_source(src)){\
+                    unchecked_jobs.push_back(std::make_unique<job_t>(\
                                         PP_JOIN(lang,_compiler_driver).get(),\
-                                        working_path,\
+                                        PP_JOIN(lang,_working_path),\
                                         src_base,\
                                         src,\
                                         src_out,\
@@ -500,14 +1010,66 @@ bool Project::build_target(const std::string & target_name) try{
                  *
                  */ \
                     \
-                linker_driver->add_file(get_link_order(target,out_base,src_out),src_out);\
+                linker_driver->add_file(get_link_order(plan.linker_order,PP_JOIN(lang,_working_path)/"obj",src_out),src_out);\
             }
         
         COMPILE_JOB(c);
-        COMPILE_JOB(cpp);
+        if(cpp_modules){
+            std::map<path,job_t*> cpp_jobs;
+            for(const path &src:modules.order){
+                if(modules.dirty[src]){
+                    job_t * job=jobs.emplace_back(std::make_unique<job_t>(cpp_compiler_driver.get(),cpp_working_path,src_base,src,get_obj_path(cpp_working_path,src_base,src),cpp_compiler_driver->module_flags(cpp_working_path,modules.deps[src]),Util::redirect_data{},false,false)).get();
+                    for(const path &provider:modules.providers[src]){
+                        if(auto it=cpp_jobs.find(provider);it!=cpp_jobs.end()){
+                            it->second->dependents.push_back(job);
+                            job->pending_deps++;
+                        }
+                    }
+                    cpp_jobs.insert({src,job});
+                }
+            }
+            for(const path &src:sources_cpp){
+                path src_out(get_obj_path(cpp_working_path,src_base,src));
+                linker_driver->add_file(get_link_order(plan.linker_order,cpp_working_path/"obj",src_out),src_out);
+            }
+        }else{
+            COMPILE_JOB(cpp);
+        }
         COMPILE_JOB(asm);
         
-        std::vector<std::unique_ptr<job_t>> finished_jobs(job_t::run_jobs(jobs));
+        job_stream stream;
+        std::atomic<size_t> next_check=0;
+        std::atomic<int> running_checkers=std::min<size_t>(drivers::compiler::io_threads(),unchecked_jobs.size());
+        
+        auto checker=[&](){
+            for(size_t i;!stream.stopped&&(i=next_check++)<unchecked_jobs.size();){
+                job_t * job=unchecked_jobs[i].get();
+                bool needs_compile=true;
+                try{
+                    needs_compile=job->driver->needs_compile(job->working_path,job->src_base,job->src,job->src_out);
+                }catch(std::exception &e){
+                    // compiling reports the error
+                }
+                if(needs_compile)stream.push(job);
+            }
+            if(--running_checkers==0)stream.closed=true;
+        };
+        
+        std::vector<std::thread> checkers;
+        for(int i=running_checkers;i>0;i--){
+            checkers.emplace_back(checker);
+        }
+        if(checkers.empty())stream.closed=true;
+        
+        std::vector<job_t*> finished_jobs;
+        try{
+            finished_jobs=job_t::run_jobs(jobs,&stream);
+        }catch(std::exception &e){
+            stream.stopped=true;
+            for(std::thread &t:checkers)t.join();
+            throw;
+        }
+        for(std::thread &t:checkers)t.join();
         
         bool ok=true;
         
@@ -523,6 +1085,8 @@ bool Project::build_target(const std::string & target_name) try{
             if(!job->success){
                 failed_files.push_back(fname);
                 ok=false;
+            }else{
+                compile_seconds[job->src]=job->seconds;
             }
         }
         
@@ -536,36 +1100,162 @@ bool Project::build_target(const std::string & target_name) try{
         
         #define COMPILE_NOJOB(lang)\
             for(const auto & src : PP_JOIN(sources_,lang) ){\
-                path src_out (get_obj_path(working_path,src_base,src));\
-                if(!PP_JOIN(lang,_compiler_driver)->needs_compile(working_path,src_base,src,src_out)\
-                  ||PP_JOIN(lang,_compiler_driver)->compile(working_path,src_base,src,src_out,{},nullptr)){\
-                    linker_driver->add_file(get_link_order(target,out_base,src_out),src_out);\
+                path src_out (get_obj_path(PP_JOIN(lang,_working_path),src_base,src));\
+                if(skip_source(src))continue;\
+                if(!PP_JOIN(lang,_compiler_driver)->needs_compile(PP_JOIN(lang,_working_path),src_base,src,src_out)\
+                  ||timed_compile(PP_JOIN(lang,_compiler_driver).get(),PP_JOIN(lang,_working_path),src_base,src,{},compile_seconds)){\
+                    linker_driver->add_file(get_link_order(plan.linker_order,PP_JOIN(lang,_working_path)/"obj",src_out),src_out);\
                 }else{\
                     throw std::runtime_error("Failed to compile "+Util::quote_str_single(std::filesystem::relative(src).string()));\
                 }\
             }
         
         COMPILE_NOJOB(c);
-        COMPILE_NOJOB(cpp);
+        if(cpp_modules){
+            for(const path &src:modules.order){
+                if(modules.dirty[src]&&!timed_compile(cpp_compiler_driver.get(),cpp_working_path,src_base,src,cpp_compiler_driver->module_flags(cpp_working_path,modules.deps[src]),compile_seconds)){
+                    throw std::runtime_error("Failed to compile "+Util::quote_str_single(std::filesystem::relative(src).string()));
+                }
+            }
+            for(const path &src:sources_cpp){
+                path src_out(get_obj_path(cpp_working_path,src_base,src));
+                linker_driver->add_file(get_link_order(plan.linker_order,cpp_working_path/"obj",src_out),src_out);
+            }
+        }else{
+            COMPILE_NOJOB(cpp);
+        }
         COMPILE_NOJOB(asm);
         
         #undef COMPILE_NOJOB
         
     }
     
-    std::string out=(
-                     (target.binary_folder_override?path(*target.binary_folder_override):(binary_folder_override?path(*binary_folder_override):(working_path/"bin")))
-                     /
-                     (
-                      (target.project_binary_override?*target.project_binary_override:project_binary)
-                      +
-                      (project_ext?*project_ext:linker_driver->get_ext())
-                     )
-                    ).string();
+    // the deps index doubles as the record of which sources the last build had, sources that are gone since get their outputs deleted,
+    // except from shared object stores, which other targets may still be using
+    size_t num_removed=0;
+    bool sources_gone=false; // the index still lists sources that are gone, even if none of their outputs were deleted
     
-    if(!linker_driver->link(working_path,out,{})){
-        throw std::runtime_error("Failed to link");
+    if(old_index){
+        std::unordered_set<std::string> current;
+        for(const path &src:sources_all){
+            current.insert(Util::project_relative(src).string());
+        }
+        
+        #define REMOVE_OUTPUTS(lang)\
+            if(Util::contains(Util::CArrayIteratorAdaptor(PP_JOIN(lang,_extensions)),src.extension().string())){\
+                if(PP_JOIN(lang,_working_path)==working_path){\
+                    remove_outputs(PP_JOIN(lang,_compiler_driver)->get_outputs(working_path,src_base,src,get_obj_path(working_path,src_base,src)),working_path);\
+                    num_removed++;\
+                }\
+            }
+        
+        for(const DepsIndex::source &old_src:old_index->sources){
+            const std::string &file=old_index->files[old_src.file];
+            if(current.contains(Util::project_relative(file).string()))continue;
+            sources_gone=true;
+            // the index has paths relative to the project root, sources are gathered relative to src base
+            const path src(src_base.is_absolute()?std::filesystem::absolute(file):path(file));
+            try{
+                REMOVE_OUTPUTS(c)
+                else REMOVE_OUTPUTS(cpp)
+                else REMOVE_OUTPUTS(asm)
+            }catch(std::exception &e){
+                // sources outside of src base never got any outputs
+            }
+        }
+        
+        #undef REMOVE_OUTPUTS
+        
+        if(num_removed>0){
+            std::cout<<"Removed the outputs of "<<num_removed<<" deleted source"<<(num_removed==1?"":"s")<<"\n";
+        }
     }
+    
+    // keep the deps index in sync with the dependency files, and the compile times of sources that weren't recompiled
+    if(!old_index||compile_seconds.size()>0||sources_gone||old_index->sources.size()!=sources_c.size()+sources_cpp.size()+sources_asm.size()){
+        std::unordered_map<std::string,double> old_seconds;
+        if(old_index){
+            old_seconds=old_index->get_compile_seconds();
+        }
+        DepsIndex index;
+        
+        #define INDEX_DEPS(lang)\
+            for(const auto & src : PP_JOIN(sources_,lang) ){\
+                double seconds=-1;\
+                if(auto it=compile_seconds.find(src);it!=compile_seconds.end()){\
+                    seconds=it->second;\
+                }else if(auto it2=old_seconds.find(Util::project_relative(src).string());it2!=old_seconds.end()){\
+                    seconds=it2->second;\
+                }\
+                index.add_source(src.string(),seconds,PP_JOIN(lang,_compiler_driver)->get_dependencies(PP_JOIN(lang,_working_path),src_base,src).value_or(std::vector<std::string>{}));\
+            }
+        
+        INDEX_DEPS(c);
+        INDEX_DEPS(cpp);
+        INDEX_DEPS(asm);
+        
+        #undef INDEX_DEPS
+        
+        index.write(deps_index_file);
+    }
+    
+    // early cutoff, recompiled objects are hashed, those that hash the same as before didn't change,
+    // and if none of the files to link did, neither can the output, so the link is skipped
+    const path output_hashes_file=get_output_hashes_path(working_path);
+    OutputHashes output_hashes=OutputHashes::read(output_hashes_file);
+    
+    if(compile_seconds.size()>0){
+        size_t num_unchanged=0;
+        
+        #define CHECK_UNCHANGED(lang)\
+            for(const auto & src : PP_JOIN(sources_,lang) ){\
+                if(!compile_seconds.contains(src))continue;\
+                const std::string obj=get_obj_path(PP_JOIN(lang,_working_path),src_base,src).string();\
+                auto old_hash=output_hashes.get_recorded(obj);\
+                if(old_hash&&old_hash==output_hashes.hash(obj))num_unchanged++;\
+            }
+        
+        CHECK_UNCHANGED(c);
+        CHECK_UNCHANGED(cpp);
+        CHECK_UNCHANGED(asm);
+        
+        #undef CHECK_UNCHANGED
+        
+        if(num_unchanged>0){
+            std::cout<<num_unchanged<<" of "<<compile_seconds.size()<<" recompiled object"<<(compile_seconds.size()==1?"":"s")<<" unchanged\n";
+        }
+    }
+    
+    if(get_shard()){
+        if(output_hashes.changed)output_hashes.write(output_hashes_file);
+        std::cout<<"Shard "<<get_shard()->index+1<<"/"<<get_shard()->count<<" has "<<in_shard.size()<<" of "<<(sources_c.size()+sources_cpp.size()+sources_asm.size())<<" sources, not linking, -link_only links the objects of all shards\n";
+        return true;
+    }
+    
+    std::string out=(plan.binary_folder/(plan.binary_name+(plan.binary_ext?*plan.binary_ext:linker_driver->get_ext()))).string();
+    
+    std::string link_stamp=linker_driver->get_signature()+"\n"+linker_driver->get_fingerprint().id()+"\n"+out+"\n";
+    for(const path &file:linker_driver->get_files()){
+        link_stamp+=file.string()+" "+output_hashes.hash(file.string()).value_or("missing")+"\n";
+    }
+    for(const path &file:linker_driver->get_lib_files()){ // other targets' libraries may have been rebuilt since
+        link_stamp+=file.string()+" "+output_hashes.hash(file.string()).value_or("missing")+"\n";
+    }
+    link_stamp=Util::sha256(link_stamp);
+    const path link_stamp_file=working_path/"tmp"/"link.stamp";
+    
+    if(!Args::has_flag("rebuild")&&std::filesystem::exists(out)&&std::filesystem::exists(link_stamp_file)&&Util::readfile(link_stamp_file.string())==link_stamp){
+        std::cout<<"Nothing to link changed, "<<Util::quote_str_single(std::filesystem::relative(out).string())<<" is up to date\n";
+    }else{
+        std::filesystem::remove(link_stamp_file);
+        if(!linker_driver->link(working_path,out,{})){
+            if(output_hashes.changed)output_hashes.write(output_hashes_file);
+            throw std::runtime_error("Failed to link");
+        }
+        std::filesystem::create_directories(link_stamp_file.parent_path());
+        Util::writefile(link_stamp_file.string(),link_stamp);
+    }
+    if(output_hashes.changed)output_hashes.write(output_hashes_file);
     return true;
 }catch(std::out_of_range &e){
     throw std::runtime_error("Invalid target "+Util::quote_str_single(target_name));
@@ -574,15 +1264,156 @@ bool Project::build_target(const std::string & target_name) try{
 void Project::clean_target(const std::string &target_name){
     using std::filesystem::path;
     
-    auto &target=targets.targets.at(target_name);
+    auto &target=targets.at(target_name);
     
     path working_path=get_working_path(target,noarch,working_folder,target_name);
     
     path obj_path(working_path/"obj");
     path tmp_path(working_path/"tmp");
     
+    // shared_objects stores go too, other targets compiling into them recompile as well
+    for(const std::string &store:read_shared_stores(working_path)){
+        if(std::filesystem::exists(store)){
+            std::cout<<"Deleting "<<std::filesystem::relative(store)<<"\n";
+            std::filesystem::remove_all(store);
+        }
+    }
     std::cout<<"Deleting "<<std::filesystem::relative(obj_path)<<"\n";
     std::filesystem::remove_all(obj_path);
     std::cout<<"Deleting "<<std::filesystem::relative(tmp_path)<<"\n";
     std::filesystem::remove_all(tmp_path);
 }
+
+bool Project::show_deps(const std::vector<std::string> &target_names,bool failexit){
+    std::vector<std::string> ts(resolve_target_groups(target_names));
+    bool fail=false;
+    for(const std::string &t:ts){
+        std::cout<<"----------------\nDependencies of target "<<Util::quote_str_single(t)<<(name?(" in "+Util::quote_str_single(*name)):"")<<"\n----------------\n";
+        try{
+            show_target_deps(t);
+        }catch(std::exception &e){
+            std::cout<<"\n\nReading dependencies of target "<<Util::quote_str_single(t)<<" failed: "<<e.what()<<"!\n\n\n";
+            if(failexit){
+                return false;
+            }
+            fail=true;
+        }
+    }
+    return !fail;
+}
+
+static std::string display_path(const std::string &file){
+    std::filesystem::path rel=std::filesystem::path(file).lexically_relative(std::filesystem::current_path());
+    return (rel.empty()||rel.native().starts_with(".."))?file:rel.string();
+}
+
+static std::string format_seconds(double seconds){
+    char buf[32];
+    snprintf(buf,sizeof(buf),"%.2fs",seconds);
+    return buf;
+}
+
+void Project::show_target_deps(const std::string &target_name){
+    using std::filesystem::path;
+    
+    auto &target=targets.at(target_name);
+    
+    path working_path=get_working_path(target,noarch,working_folder,target_name);
+    
+    std::optional<DepsIndex> index=DepsIndex::read(get_deps_index_path(working_path));
+    
+    if(!index){
+        std::cout<<"No dependency index, build the target first\n";
+        return;
+    }
+    
+    const size_t num_files=index->files.size();
+    
+    std::vector<bool> is_source(num_files,false);
+    for(const DepsIndex::source &src:index->sources){
+        is_source[src.file]=true;
+    }
+    
+    if(Args::named.contains("header")){
+        const std::string header=Args::namedArg("header");
+        const path header_norm=std::filesystem::absolute(header).lexically_normal();
+        
+        std::optional<uint32_t> id;
+        for(uint32_t i=0;i<num_files&&!id;i++){
+            if(index->files[i]==header||std::filesystem::absolute(index->files[i]).lexically_normal()==header_norm){
+                id=i;
+            }
+        }
+        
+        if(!id){
+            std::cout<<"No source in this target depends on "<<Util::quote_str_single(header)<<"\n";
+            return;
+        }
+        
+        std::vector<const DepsIndex::source*> dependents;
+        double total=0;
+        size_t num_timed=0;
+        for(const DepsIndex::source &src:index->sources){
+            if(std::find(src.deps.begin(),src.deps.end(),*id)!=src.deps.end()){
+                dependents.push_back(&src);
+                if(src.compile_seconds>=0){
+                    total+=src.compile_seconds;
+                    num_timed++;
+                }
+            }
+        }
+        
+        std::sort(dependents.begin(),dependents.end(),[](const DepsIndex::source *a,const DepsIndex::source *b){
+            return a->compile_seconds>b->compile_seconds;
+        });
+        
+        for(const DepsIndex::source *src:dependents){
+            std::cout<<"  "<<std::setw(9)<<(src->compile_seconds>=0?format_seconds(src->compile_seconds):"?")<<"  "<<display_path(index->files[src->file])<<"\n";
+        }
+        
+        std::cout<<"\n"<<dependents.size()<<" of "<<index->sources.size()<<" sources depend on "<<Util::quote_str_single(display_path(index->files[*id]))
+                 <<(num_timed==0?", no compile times recorded yet\n"
+                   :(", changing it costs "+std::string(num_timed<dependents.size()?"at least ":"")+format_seconds(total)+" of compile time\n"));
+    }else{
+        const size_t max_shown=Args::namedIntArgOr("top",25,false);
+        
+        std::vector<size_t> fan_in(num_files,0);
+        std::vector<double> cost(num_files,0);
+        bool timed=false;
+        for(const DepsIndex::source &src:index->sources){
+            for(uint32_t dep:src.deps){
+                fan_in[dep]++;
+                if(src.compile_seconds>=0){
+                    cost[dep]+=src.compile_seconds;
+                    timed=true;
+                }
+            }
+        }
+        
+        std::vector<uint32_t> headers;
+        for(uint32_t i=0;i<num_files;i++){
+            if(!is_source[i]&&fan_in[i]>0)headers.push_back(i);
+        }
+        
+        // without compile times, fall back to ranking by how many sources include the header
+        std::sort(headers.begin(),headers.end(),[&](uint32_t a,uint32_t b){
+            return timed?(cost[a]!=cost[b]?cost[a]>cost[b]:fan_in[a]>fan_in[b])
+                        :(fan_in[a]!=fan_in[b]?fan_in[a]>fan_in[b]:cost[a]>cost[b]);
+        });
+        
+        std::cout<<"  "<<std::setw(7)<<"fan-in"<<"  "<<std::setw(9)<<"cost"<<"  header\n";
+        for(size_t i=0;i<headers.size()&&i<max_shown;i++){
+            std::cout<<"  "<<std::setw(7)<<fan_in[headers[i]]<<"  "<<std::setw(9)<<(timed?format_seconds(cost[headers[i]]):"?")<<"  "<<display_path(index->files[headers[i]])<<"\n";
+        }
+        if(headers.size()>max_shown){
+            std::cout<<"     ...  "<<(headers.size()-max_shown)<<" more\n";
+        }
+        
+        double total=0;
+        for(const DepsIndex::source &src:index->sources){
+            if(src.compile_seconds>=0)total+=src.compile_seconds;
+        }
+        
+        std::cout<<"\n"<<headers.size()<<" headers, "<<index->sources.size()<<" sources"<<(timed?(", "+format_seconds(total)+" of compile time"):"")<<"\n";
+    }
+}
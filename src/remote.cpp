@@ -0,0 +1,581 @@
+#include "remote.h"
+#include "util.h"
+#include "run.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <filesystem>
+#include <map>
+
+#if defined(__unix__)
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <netdb.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+#endif
+
+// wire format, every integer is a little-endian u32, every string a u32 length followed by its bytes
+//   request  : "RBW2" program nargs args... ninputs (name data)... noutputs names...
+//   response : "RBW2" ran status stdout stderr noutputs (present [data])..., 'ran' is 0 if the worker itself failed, with the reason in stderr
+// the cache speaks plain HTTP/1.1, one request per connection
+
+namespace Remote {
+    
+    namespace {
+        
+        constexpr char magic[4]{'R','B','W','2'};
+        
+        struct worker {
+            std::string endpoint;
+            std::atomic<bool> dead=false;
+        };
+        
+        std::vector<std::unique_ptr<worker>> workers;
+        std::atomic<size_t> next_worker=0;
+        
+        struct cache_t {
+            std::string url;
+            std::string endpoint; // 'host:port'
+            std::string host;
+            std::string prefix; // path in front of '/ac/' and '/cas/'
+            std::atomic<bool> dead=false;
+        };
+        
+        std::unique_ptr<cache_t> cache;
+        
+        #if defined(__unix__)
+            
+            class socket_t {
+                int fd;
+            public:
+                explicit socket_t(int f):fd(f){}
+                socket_t(const socket_t&)=delete;
+                ~socket_t(){
+                    if(fd>=0)close(fd);
+                }
+                
+                int get(){
+                    return fd;
+                }
+                
+                void write_all(const char * data,size_t n){
+                    while(n>0){
+                        ssize_t w=send(fd,data,n,MSG_NOSIGNAL);
+                        if(w<0&&errno==EINTR)continue;
+                        if(w<=0)throw std::runtime_error("send failed: "+std::string(strerror(errno)));
+                        data+=w;
+                        n-=w;
+                    }
+                }
+                
+                size_t read_some(char * data,size_t n){ // 0 once the connection is closed
+                    while(true){
+                        ssize_t r=recv(fd,data,n,0);
+                        if(r<0&&errno==EINTR)continue;
+                        if(r<0)throw std::runtime_error("recv failed: "+std::string(strerror(errno)));
+                        return r;
+                    }
+                }
+                
+                void read_all(char * data,size_t n){
+                    while(n>0){
+                        ssize_t r=recv(fd,data,n,0);
+                        if(r<0&&errno==EINTR)continue;
+                        if(r==0)throw std::runtime_error("connection closed");
+                        if(r<0)throw std::runtime_error("recv failed: "+std::string(strerror(errno)));
+                        data+=r;
+                        n-=r;
+                    }
+                }
+            };
+            
+            // messages are assembled in memory and sent in one go
+            class writer {
+                std::string buf;
+            public:
+                writer(){
+                    buf.append(magic,sizeof(magic));
+                }
+                
+                void u32(uint32_t n){
+                    char b[4]{char(n&0xFF),char((n>>8)&0xFF),char((n>>16)&0xFF),char((n>>24)&0xFF)};
+                    buf.append(b,4);
+                }
+                
+                void str(const std::string &s){
+                    u32(s.size());
+                    buf+=s;
+                }
+                
+                void send(socket_t &s){
+                    s.write_all(buf.data(),buf.size());
+                }
+            };
+            
+            class reader {
+                socket_t &s;
+            public:
+                explicit reader(socket_t &so):s(so){
+                    char m[4];
+                    s.read_all(m,4);
+                    if(memcmp(m,magic,4)!=0)throw std::runtime_error("protocol mismatch");
+                }
+                
+                uint32_t u32(){
+                    unsigned char b[4];
+                    s.read_all(reinterpret_cast<char*>(b),4);
+                    return uint32_t(b[0])|(uint32_t(b[1])<<8)|(uint32_t(b[2])<<16)|(uint32_t(b[3])<<24);
+                }
+                
+                std::string str(){
+                    std::string out(u32(),'\0');
+                    s.read_all(out.data(),out.size());
+                    return out;
+                }
+            };
+            
+            struct endpoint_addr {
+                int family;
+                sockaddr_storage addr;
+                socklen_t len;
+            };
+            
+            endpoint_addr resolve(const std::string &endpoint){
+                endpoint_addr out{};
+                if(endpoint.starts_with("unix:")){
+                    sockaddr_un * un=reinterpret_cast<sockaddr_un*>(&out.addr);
+                    const std::string p=endpoint.substr(5);
+                    if(p.size()>=sizeof(un->sun_path))throw std::runtime_error("unix socket path too long "+Util::quote_str_single(p));
+                    un->sun_family=AF_UNIX;
+                    memcpy(un->sun_path,p.c_str(),p.size()+1);
+                    out.family=AF_UNIX;
+                    out.len=sizeof(sockaddr_un);
+                    return out;
+                }
+                size_t colon=endpoint.rfind(':');
+                if(colon==std::string::npos)throw std::runtime_error("invalid endpoint "+Util::quote_str_single(endpoint)+", expected 'host:port' or 'unix:/path'");
+                addrinfo hints{};
+                hints.ai_family=AF_UNSPEC;
+                hints.ai_socktype=SOCK_STREAM;
+                addrinfo * res;
+                if(int err=getaddrinfo(endpoint.substr(0,colon).c_str(),endpoint.substr(colon+1).c_str(),&hints,&res);err!=0){
+                    throw std::runtime_error("cannot resolve "+Util::quote_str_single(endpoint)+": "+gai_strerror(err));
+                }
+                out.family=res->ai_family;
+                memcpy(&out.addr,res->ai_addr,res->ai_addrlen);
+                out.len=res->ai_addrlen;
+                freeaddrinfo(res);
+                return out;
+            }
+            
+            std::unique_ptr<socket_t> connect_to(const std::string &endpoint){
+                endpoint_addr a=resolve(endpoint);
+                auto s=std::make_unique<socket_t>(socket(a.family,SOCK_STREAM|SOCK_CLOEXEC,0));
+                if(s->get()<0)throw std::runtime_error("socket failed: "+std::string(strerror(errno)));
+                if(connect(s->get(),reinterpret_cast<sockaddr*>(&a.addr),a.len)!=0){
+                    throw std::runtime_error("cannot connect to "+Util::quote_str_single(endpoint)+": "+strerror(errno));
+                }
+                if(a.family!=AF_UNIX){
+                    int one=1;
+                    setsockopt(s->get(),IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+                }
+                return s;
+            }
+            
+            std::string replace_scratch(std::string arg,const std::string &scratch){
+                for(size_t i=0;(i=arg.find("%w",i))!=std::string::npos;i+=scratch.size()){
+                    arg.replace(i,2,scratch);
+                }
+                return arg;
+            }
+            
+            // limits how many requests a worker runs at once
+            class slots_t {
+                std::mutex mutex;
+                std::condition_variable cv;
+                int free;
+            public:
+                explicit slots_t(int n):free(n){}
+                
+                void acquire(){
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock,[this](){return free>0;});
+                    free--;
+                }
+                
+                void release(){
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        free++;
+                    }
+                    cv.notify_one();
+                }
+            };
+            
+            // the worker's own path for 'program', if its file name, or its full path, was allowed with -allow
+            std::optional<std::string> allowed_program(const std::string &program,const std::vector<std::string> &allowed){
+                if(Util::contains(allowed,program))return program;
+                const std::string name=std::filesystem::path(program).filename().string();
+                if(!Util::contains(allowed,name))return std::nullopt;
+                // never the client's path, only the worker's own install of the compiler
+                std::string resolved=Util::find_executable(name);
+                if(resolved==name)throw std::runtime_error(Util::quote_str_single(name)+" not found");
+                return resolved;
+            }
+            
+            void handle(std::unique_ptr<socket_t> s,slots_t &slots,const std::vector<std::string> &allowed) try {
+                static std::atomic<size_t> next_scratch=0;
+                
+                reader r(*s);
+                std::string program=r.str();
+                std::vector<std::string> args(r.u32());
+                for(std::string &arg:args)arg=r.str();
+                std::vector<file> inputs(r.u32());
+                for(file &f:inputs){
+                    f.name=r.str();
+                    f.data=r.str();
+                }
+                std::vector<std::string> outputs(r.u32());
+                for(std::string &o:outputs)o=r.str();
+                
+                const std::filesystem::path scratch=std::filesystem::temp_directory_path()/("rbuild-worker-"+std::to_string(getpid())+"-"+std::to_string(next_scratch++));
+                std::filesystem::create_directories(scratch);
+                
+                writer w;
+                slots.acquire();
+                try{
+                    for(const file &f:inputs){
+                        const std::filesystem::path p=(scratch/f.name).lexically_normal();
+                        if(f.name.empty()||std::filesystem::path(f.name).is_absolute()||!Util::subpath_relative(scratch,p)){
+                            throw std::runtime_error("input "+Util::quote_str_single(f.name)+" outside of the scratch folder");
+                        }
+                        std::filesystem::create_directories(p.parent_path());
+                        Util::writefile(p.string(),f.data,true);
+                    }
+                    std::optional<std::string> resolved=allowed_program(program,allowed);
+                    if(!resolved)throw std::runtime_error(Util::quote_str_single(program)+" isn't allowed to run on this worker");
+                    Util::redirect_data rd;
+                    int status=Util::run(*resolved,Util::map(args,[&scratch](const std::string &arg){return replace_scratch(arg,scratch.string());}),&Util::alternate_cmdline_args_to_file_regular,true,&rd,scratch);
+                    rd.stop();
+                    w.u32(1);
+                    w.u32(status);
+                    w.str(rd.s_stdout);
+                    w.str(rd.s_stderr);
+                    w.u32(outputs.size());
+                    for(const std::string &o:outputs){
+                        const std::filesystem::path p=scratch/o;
+                        const bool present=Util::subpath_relative(scratch,p.lexically_normal())&&std::filesystem::is_regular_file(p);
+                        w.u32(present);
+                        if(present)w.str(Util::readfile(p.string(),true));
+                    }
+                }catch(std::exception &e){
+                    Util::print_sync("rbuild-worker: "+std::string(e.what())+"\n");
+                    w=writer();
+                    w.u32(0);
+                    w.str(e.what());
+                }
+                slots.release();
+                std::error_code ec;
+                std::filesystem::remove_all(scratch,ec);
+                w.send(*s);
+            }catch(std::exception &e){
+                Util::print_sync("rbuild-worker: "+std::string(e.what())+"\n");
+            }
+            
+            std::unique_ptr<socket_t> listen_on(const std::string &endpoint){
+                endpoint_addr a=resolve(endpoint);
+                if(a.family==AF_UNIX){
+                    std::filesystem::remove(endpoint.substr(5));
+                }
+                auto s=std::make_unique<socket_t>(socket(a.family,SOCK_STREAM|SOCK_CLOEXEC,0));
+                if(s->get()<0)throw std::runtime_error("socket failed: "+std::string(strerror(errno)));
+                int one=1;
+                setsockopt(s->get(),SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+                if(bind(s->get(),reinterpret_cast<sockaddr*>(&a.addr),a.len)!=0){
+                    throw std::runtime_error("cannot bind "+Util::quote_str_single(endpoint)+": "+strerror(errno));
+                }
+                if(listen(s->get(),SOMAXCONN)!=0){
+                    throw std::runtime_error("cannot listen on "+Util::quote_str_single(endpoint)+": "+strerror(errno));
+                }
+                return s;
+            }
+            
+            template<typename F>
+            [[noreturn]] void accept_loop(socket_t &s,F &&on_connection){
+                while(true){
+                    int fd=accept4(s.get(),nullptr,nullptr,SOCK_CLOEXEC);
+                    if(fd<0){
+                        if(errno==EINTR||errno==ECONNABORTED)continue;
+                        throw std::runtime_error("accept failed: "+std::string(strerror(errno)));
+                    }
+                    on_connection(std::make_unique<socket_t>(fd));
+                }
+            }
+            
+            struct http_message {
+                std::string start_line;
+                std::map<std::string,std::string> headers; // by lowercase name
+                std::string body;
+            };
+            
+            // the body is 'Content-Length' bytes long, or without one, for responses, everything up to the end of the connection
+            http_message read_http(socket_t &s,bool is_response){
+                std::string buf;
+                char chunk[16_K];
+                size_t header_end;
+                while((header_end=buf.find("\r\n\r\n"))==std::string::npos){
+                    if(buf.size()>64_K)throw std::runtime_error("HTTP header too long");
+                    size_t n=s.read_some(chunk,sizeof(chunk));
+                    if(n==0)throw std::runtime_error("connection closed");
+                    buf.append(chunk,n);
+                }
+                http_message m;
+                std::vector<std::string> lines=Util::split_str(buf.substr(0,header_end),"\r\n");
+                m.start_line=lines[0];
+                for(size_t i=1;i<lines.size();i++){
+                    size_t colon=lines[i].find(':');
+                    if(colon==std::string::npos)continue;
+                    std::string value=lines[i].substr(colon+1);
+                    value.erase(0,value.find_first_not_of(' '));
+                    m.headers[Util::str_tolower(lines[i].substr(0,colon))]=value;
+                }
+                m.body=buf.substr(header_end+4);
+                if(auto it=m.headers.find("transfer-encoding");it!=m.headers.end()&&it->second!="identity"){
+                    throw std::runtime_error("unsupported transfer encoding "+Util::quote_str_single(it->second));
+                }
+                if(auto it=m.headers.find("content-length");it!=m.headers.end()){
+                    const size_t len=std::stoull(it->second);
+                    const size_t have=std::min(len,m.body.size());
+                    m.body.resize(len);
+                    s.read_all(m.body.data()+have,len-have);
+                }else if(is_response){
+                    for(size_t n;(n=s.read_some(chunk,sizeof(chunk)))>0;){
+                        m.body.append(chunk,n);
+                    }
+                }else{
+                    m.body.clear();
+                }
+                return m;
+            }
+            
+            void write_http(socket_t &s,const std::string &start_line,const std::vector<std::string> &headers,const std::string &body){
+                std::string head=start_line+"\r\n";
+                for(const std::string &h:headers)head+=h+"\r\n";
+                head+="Content-Length: "+std::to_string(body.size())+"\r\nConnection: close\r\n\r\n";
+                s.write_all(head.data(),head.size());
+                s.write_all(body.data(),body.size());
+            }
+            
+            // returns the status and body
+            std::pair<int,std::string> http_request(const cache_t &c,const std::string &method,const std::string &target,const std::string &body){
+                std::unique_ptr<socket_t> s=connect_to(c.endpoint);
+                write_http(*s,method+" "+c.prefix+target+" HTTP/1.1",{"Host: "+c.host},body);
+                http_message res=read_http(*s,true);
+                std::vector<std::string> status=Util::split(res.start_line,' ');
+                if(status.size()<2||!status[0].starts_with("HTTP/"))throw std::runtime_error("malformed HTTP response");
+                return {std::stoi(status[1]),std::move(res.body)};
+            }
+            
+            bool valid_cache_key(const std::string &key){
+                return key.size()==64&&key.find_first_not_of("0123456789abcdef")==std::string::npos;
+            }
+            
+            // GET/HEAD/PUT '[anything]/ac/[key]' and '[anything]/cas/[key]', checking that 'cas' entries match their hash
+            void handle_cache(std::unique_ptr<socket_t> s,const std::filesystem::path &folder) try {
+                static std::atomic<size_t> next_tmp=0;
+                
+                http_message req=read_http(*s,false);
+                std::vector<std::string> request_line=Util::split(req.start_line,' ');
+                std::vector<std::string> target=request_line.size()>=2?Util::split(request_line[1],'/'):std::vector<std::string>{};
+                const std::string method=request_line.size()>=2?request_line[0]:"";
+                const std::string kind=target.size()>=2?target[target.size()-2]:"";
+                const std::string key=target.size()>=2?target.back():"";
+                
+                std::string status="200 OK";
+                std::string body;
+                if(method!="GET"&&method!="HEAD"&&method!="PUT"){
+                    status="405 Method Not Allowed";
+                }else if((kind!="ac"&&kind!="cas")||!valid_cache_key(key)){
+                    status="400 Bad Request";
+                }else if(method=="PUT"){
+                    if(kind=="cas"&&Util::sha256(req.body)!=key){
+                        status="400 Bad Request";
+                        body="content doesn't match its hash\n";
+                    }else{
+                        // written under a temporary name then renamed, so that concurrent readers never see partial entries
+                        const std::filesystem::path file=folder/kind/key;
+                        const std::filesystem::path tmp=folder/kind/(key+".tmp"+std::to_string(getpid())+"-"+std::to_string(next_tmp++));
+                        std::filesystem::create_directories(folder/kind);
+                        Util::writefile(tmp.string(),req.body,true);
+                        std::filesystem::rename(tmp,file);
+                    }
+                }else if(std::filesystem::is_regular_file(folder/kind/key)){
+                    body=Util::readfile((folder/kind/key).string(),true);
+                }else{
+                    status="404 Not Found";
+                }
+                if(method=="HEAD"){
+                    std::string head="HTTP/1.1 "+status+"\r\nContent-Length: "+std::to_string(body.size())+"\r\nConnection: close\r\n\r\n";
+                    s->write_all(head.data(),head.size());
+                }else{
+                    write_http(*s,"HTTP/1.1 "+status,{},body);
+                }
+            }catch(std::exception &e){
+                Util::print_sync("rbuild-cache: "+std::string(e.what())+"\n");
+            }
+        
+        #endif
+    
+    }
+    
+    void set_workers(const std::vector<std::string> &endpoints){
+        workers.clear();
+        for(const std::string &e:endpoints){
+            workers.push_back(std::make_unique<worker>());
+            workers.back()->endpoint=e;
+        }
+    }
+    
+    bool enabled(){
+        return !workers.empty();
+    }
+    
+    std::optional<response> execute(const request &req){
+        #if defined(__unix__)
+            for(size_t tries=0;tries<workers.size();tries++){
+                worker &wk=*workers[next_worker++%workers.size()];
+                if(wk.dead)continue;
+                std::unique_ptr<socket_t> s;
+                try{
+                    s=connect_to(wk.endpoint);
+                }catch(std::exception &e){
+                    // unreachable workers are skipped for the rest of the build
+                    if(!wk.dead.exchange(true))Util::print_sync("Worker "+Util::quote_str_single(wk.endpoint)+" unavailable, "+e.what()+"\n");
+                    continue;
+                }
+                writer w;
+                w.str(req.program);
+                w.u32(req.args.size());
+                for(const std::string &arg:req.args)w.str(arg);
+                w.u32(req.inputs.size());
+                for(const file &f:req.inputs){
+                    w.str(f.name);
+                    w.str(f.data);
+                }
+                w.u32(req.outputs.size());
+                for(const std::string &o:req.outputs)w.str(o);
+                try{
+                    w.send(*s);
+                    reader r(*s);
+                    if(!r.u32()){
+                        // the worker couldn't run the compiler at all, it's skipped for the rest of the build like an unreachable one
+                        const std::string reason=r.str();
+                        if(!wk.dead.exchange(true))Util::print_sync("Worker "+Util::quote_str_single(wk.endpoint)+" failed, "+reason+"\n");
+                        continue;
+                    }
+                    response res;
+                    res.status=int32_t(r.u32());
+                    res.s_stdout=r.str();
+                    res.s_stderr=r.str();
+                    res.outputs.resize(r.u32());
+                    for(std::optional<std::string> &o:res.outputs){
+                        if(r.u32())o=r.str();
+                    }
+                    return res;
+                }catch(std::exception &e){
+                    if(!wk.dead.exchange(true))Util::print_sync("Worker "+Util::quote_str_single(wk.endpoint)+" failed, "+e.what()+"\n");
+                }
+            }
+            return std::nullopt;
+        #else
+            throw std::runtime_error("remote compilation is only supported on unix");
+        #endif
+    }
+    
+    void serve(const std::string &endpoint,int max_jobs,const std::vector<std::string> &allowed_programs){
+        #if defined(__unix__)
+            std::unique_ptr<socket_t> s=listen_on(endpoint);
+            slots_t slots(max_jobs);
+            std::cout<<"rbuild-worker listening on "<<endpoint<<", running up to "<<max_jobs<<" jobs at once, allowing "<<Util::join(allowed_programs,", ")<<std::endl;
+            accept_loop(*s,[&slots,&allowed_programs](std::unique_ptr<socket_t> c){
+                std::thread(handle,std::move(c),std::ref(slots),std::cref(allowed_programs)).detach();
+            });
+        #else
+            throw std::runtime_error("rbuild-worker is only supported on unix");
+        #endif
+    }
+    
+    void set_cache(const std::string &url){
+        if(!url.starts_with("http://"))throw std::runtime_error("invalid cache url "+Util::quote_str_single(url)+", expected 'http://host:port[/prefix]'");
+        cache=std::make_unique<cache_t>();
+        cache->url=url;
+        const std::string rest=url.substr(7);
+        const size_t slash=rest.find('/');
+        cache->host=rest.substr(0,slash);
+        cache->endpoint=cache->host.find(':')==std::string::npos?cache->host+":80":cache->host;
+        cache->prefix=slash==std::string::npos?"":rest.substr(slash);
+        while(cache->prefix.ends_with("/"))cache->prefix.pop_back();
+    }
+    
+    bool cache_enabled(){
+        return cache&&!cache->dead;
+    }
+    
+    std::optional<std::string> cache_get(const std::string &kind,const std::string &key){
+        if(!cache_enabled())return std::nullopt;
+        #if defined(__unix__)
+            try{
+                auto [status,body]=http_request(*cache,"GET","/"+kind+"/"+key,"");
+                if(status==404)return std::nullopt;
+                if(status!=200)throw std::runtime_error("HTTP status "+std::to_string(status));
+                if(kind=="cas"&&Util::sha256(body)!=key)return std::nullopt; // corrupted, treated as a miss and overwritten by the next upload
+                return body;
+            }catch(std::exception &e){
+                // a failing cache is ignored for the rest of the build, sources are compiled as if it missed
+                if(!cache->dead.exchange(true))Util::print_sync("Remote cache "+Util::quote_str_single(cache->url)+" unavailable, "+e.what()+"\n");
+                return std::nullopt;
+            }
+        #else
+            throw std::runtime_error("the remote cache is only supported on unix");
+        #endif
+    }
+    
+    void cache_put(const std::string &kind,const std::string &key,const std::string &data){
+        if(!cache_enabled())return;
+        #if defined(__unix__)
+            try{
+                auto [status,body]=http_request(*cache,"PUT","/"+kind+"/"+key,data);
+                if(status<200||status>=300)throw std::runtime_error("HTTP status "+std::to_string(status));
+            }catch(std::exception &e){
+                if(!cache->dead.exchange(true))Util::print_sync("Remote cache "+Util::quote_str_single(cache->url)+" unavailable, "+e.what()+"\n");
+            }
+        #else
+            throw std::runtime_error("the remote cache is only supported on unix");
+        #endif
+    }
+    
+    void serve_cache(const std::string &endpoint,const std::string &folder){
+        #if defined(__unix__)
+            std::unique_ptr<socket_t> s=listen_on(endpoint);
+            const std::filesystem::path root=std::filesystem::absolute(folder);
+            std::filesystem::create_directories(root);
+            std::cout<<"rbuild-cache listening on "<<endpoint<<", storing entries in "<<Util::quote_str_single(root.string())<<std::endl;
+            accept_loop(*s,[&root](std::unique_ptr<socket_t> c){
+                std::thread(handle_cache,std::move(c),root).detach();
+            });
+        #else
+            throw std::runtime_error("rbuild-cache is only supported on unix");
+        #endif
+    }
+
+}
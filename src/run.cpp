@@ -6,13 +6,15 @@
 #include <stdexcept>
 #include <cerrno>
 #include <cstring>
-#include <mutex>
+#include <atomic>
+#include <optional>
 
 #ifdef __unix__
     #include <unistd.h>
     #include <spawn.h>
     #include <sys/wait.h>
     #include <sys/ioctl.h>
+    #include <sys/stat.h>
     #include <fcntl.h>
     extern char **environ;
 #elif defined(_WIN32)
@@ -53,36 +55,116 @@
     #define CREATEPROCESS_CMD_MAX 32_K
 #endif
 
+#if defined(__unix__)
+    //well below linux's ARG_MAX, leaves room for the environment and for single arguments being capped at MAX_ARG_STRLEN
+    #define SPAWN_ARGS_MAX 128_K
+#endif
+
 namespace Util {
     
-    int run_noexcept(const std::string &program,const std::vector<std::string> &args_in,std::string (*alternate_cmdline)(const std::string&,const std::vector<std::string>&),bool silent,redirect_data * redir_data) noexcept {
+    namespace {
+        class args_file { // arguments file owned by a single run() call, so parallel jobs never share or overwrite one
+            std::filesystem::path file;
+        public:
+            args_file(const std::filesystem::path &folder,const std::vector<std::string> &args_in){
+                static std::atomic<unsigned> counter(0);
+                if(!folder.empty()) std::filesystem::create_directories(folder);
+                #if defined(__unix__)
+                    const unsigned long pid=getpid();
+                #elif defined(_WIN32)
+                    const unsigned long pid=GetCurrentProcessId();
+                #endif
+                file=folder/("args."+std::to_string(pid)+"."+std::to_string(counter++)+".rsp");
+                std::ofstream f(file);
+                if(!f){
+                    throw std::runtime_error("Failed to create arguments file "+quote_str_single(file.string())+" : "+strerror(errno));
+                }
+                f<<join(map(args_in,&quote_str_double),"\n");
+            }
+            ~args_file(){
+                std::error_code ec;
+                std::filesystem::remove(file,ec);
+            }
+            std::string name() const {
+                return file.string();
+            }
+        };
+    }
+    
+    int run_noexcept(const std::string &program,const std::vector<std::string> &args_in,alternate_cmdline_t alternate_cmdline,bool silent,redirect_data * redir_data,const std::filesystem::path &args_file_folder) noexcept {
         try{
-            return run(program,args_in,alternate_cmdline,silent,redir_data);
+            return run(program,args_in,alternate_cmdline,silent,redir_data,args_file_folder);
         }catch(std::exception &e){
             std::cerr<<"Run "+Util::quote_str_single(program)+" Failed: "<<e.what()<<"\n";
             return -1;
         }
     }
     
-    int run(std::string program,const std::vector<std::string> &args_in,std::string (*alternate_cmdline)(const std::string&,const std::vector<std::string>&),bool silent,redirect_data * redir_data){
+    std::string find_executable(const std::string &program){
+        #if defined(__unix__)
+            if(program.empty()||program.find('/')!=std::string::npos){
+                return program;
+            }
+            const char * path_env=getenv("PATH");
+            for(const std::string &dir:split(path_env?path_env:"/bin:/usr/bin",':')){
+                std::string full=dir+"/"+program;
+                struct stat st;
+                if(stat(full.c_str(),&st)==0&&S_ISREG(st.st_mode)&&access(full.c_str(),X_OK)==0){
+                    return full;
+                }
+            }
+            return program;
+        #elif defined(_WIN32)
+            bool path_found=false;
+            std::string path=resolve_path(program.ends_with(".exe")?program:program+".exe",path_found);
+            return path_found?path:program;
+        #endif
+    }
+    
+    int run(std::string program,const std::vector<std::string> &args_in,alternate_cmdline_t alternate_cmdline,bool silent,redirect_data * redir_data,const std::filesystem::path &args_file_folder){
         #if defined(__unix__)
-            std::vector<std::string> args_v;
-            args_v.reserve(std::size(args_in)+1);
-            args_v.push_back(program);
-            std::copy(std::begin(args_in),std::end(args_in),std::back_inserter(args_v));
-            std::vector<const char *> args(get_cstrs(args_v));
+            std::optional<args_file> af;
+            std::vector<std::string> file_args;
+            const std::vector<std::string> * spawn_args=&args_in;
+            if(alternate_cmdline){
+                size_t args_size=program.size()+1;
+                for(const std::string &arg:args_in){
+                    args_size+=arg.size()+1+sizeof(char*);
+                }
+                if(args_size>=SPAWN_ARGS_MAX){
+                    af.emplace(args_file_folder,args_in);
+                    file_args=alternate_cmdline(af->name());
+                    spawn_args=&file_args;
+                }
+            }
+            //point directly into the caller's strings, no need to copy the whole argument list for every spawn
+            std::vector<const char *> args;
+            args.reserve(std::size(*spawn_args)+2);
+            args.push_back(program.c_str());
+            for(const std::string &arg:*spawn_args){
+                args.push_back(arg.c_str());
+            }
             args.push_back(nullptr);
             pid_t pid;
             if(!silent)print_sync(program+" "+join(map(args_in,&quote_str_double))+"\n");
             if(redir_data){
                 redir_data->start();
             }
-            if(int err=posix_spawnp(&pid,program.c_str(),redir_data?&redir_data->f_acts:nullptr,nullptr,const_cast<char*const*>(args.data()),environ);err==0){
+            posix_spawnattr_t attr;
+            posix_spawnattr_init(&attr);
+            #ifdef POSIX_SPAWN_USEVFORK
+                posix_spawnattr_setflags(&attr,POSIX_SPAWN_USEVFORK);
+            #endif
+            //programs that were already resolved by find_executable skip the PATH search
+            const bool has_path=program.find('/')!=std::string::npos;
+            int err=(has_path?posix_spawn:posix_spawnp)(&pid,program.c_str(),redir_data?&redir_data->f_acts:nullptr,&attr,const_cast<char*const*>(args.data()),environ);
+            posix_spawnattr_destroy(&attr);
+            if(err==0){
                 int status;
                 waitpid(pid,&status,0);
                 return WIFEXITED(status)?WEXITSTATUS(status):-1;
             }else{
-                throw std::runtime_error("posix_spawnp: "+std::string(strerror(err)));
+                throw std::runtime_error(std::string(has_path?"posix_spawn: ":"posix_spawnp: ")+strerror(err));
             }
         #elif defined(_WIN32)
             if(!program.ends_with(".exe"))program+=".exe";
@@ -99,9 +181,11 @@ namespace Util {
                     si.hStdError=redir_data->hStdErr;
                 }
                 std::string args=build_cmdline(path,args_in);
+                std::optional<args_file> af;
                 if(args.size()>=CREATEPROCESS_CMD_MAX){
                     if(alternate_cmdline){
-                        args=alternate_cmdline(path,args_in);
+                        af.emplace(args_file_folder,args_in);
+                        args=build_cmdline(path,alternate_cmdline(af->name()));
                         if(args.size()>=CREATEPROCESS_CMD_MAX){
                             throw std::runtime_error("Running '"+program+"': Command line too long, is "+std::to_string(args.size())+", max "+std::to_string(CREATEPROCESS_CMD_MAX));
                         }
@@ -128,28 +212,6 @@ namespace Util {
         #endif
     }
     
-    bool tmpfile_init=false;
-    std::string tmpfile_name="tmp.args";
-    std::mutex tmpfile_mutex;
-    
-    std::string alternate_cmdline_args_to_file(const std::string &program,const std::vector<std::string> &args_in,const std::string &file_arg){
-        std::lock_guard _(tmpfile_mutex);
-        tmpfile_init=true;
-        {
-            std::ofstream f(tmpfile_name);
-            f<<join(map(args_in,&quote_str_double),"\n");
-        }
-        return program+file_arg+tmpfile_name;
-    }
-    
-    static void remove_tmpfile() __attribute__((destructor));
-    
-    void remove_tmpfile(){
-        if(tmpfile_init){
-            remove(tmpfile_name.c_str());
-        }
-    }
-    
     redirect_data::redirect_data():running(false){
         #if defined(__unix__)
             close_fds=false;
@@ -289,20 +351,28 @@ namespace Util {
     }
     
     void redirect_data::thread_main() try {
-        while(running){
+        for(bool last=false;!last;){
+            last=!running; // after stop(), drain what the process wrote right before exiting, until the pipes are empty
+            bool got=false;
             #if defined(__unix__)
                 int n;
                 if(ioctl(p_stdout[0],FIONREAD,&n)==0&&n>0){
                     char buf[n+1];
                     int r=read(p_stdout[0],buf,n);
-                    buf[r]=0;
-                    s_stdout+=std::string(buf);
+                    if(r>0){
+                        buf[r]=0;
+                        s_stdout+=std::string(buf);
+                        got=true;
+                    }
                 }
                 if(ioctl(p_stderr[0],FIONREAD,&n)==0&&n>0){
                     char buf[n+1];
                     int r=read(p_stderr[0],buf,n);
-                    buf[r]=0;
-                    s_stderr+=std::string(buf);
+                    if(r>0){
+                        buf[r]=0;
+                        s_stderr+=std::string(buf);
+                        got=true;
+                    }
                 }
             #elif defined(_WIN32)
                 DWORD num;
@@ -315,6 +385,7 @@ namespace Util {
                     ReadFile(hStdOutPipe,buf,num,&numread,nullptr);
                     buf[numread]=0;
                     s_stdout+=std::string(buf);
+                    got=numread>0;
                 }
                 if(!PeekNamedPipe(hStdErrPipe,nullptr,0,nullptr,&num,nullptr)){
                     throw std::runtime_error("redirect_data::thread_main: PeekNamedPipe hStdInR failed: "+Win32ErrStr(GetLastError()));
@@ -325,9 +396,14 @@ namespace Util {
                     ReadFile(hStdErrPipe,buf,num,&numread,nullptr);
                     buf[numread]=0;
                     s_stderr+=std::string(buf);
+                    got=got||numread>0;
                 }
             #endif
-            std::this_thread::yield();
+            if(last&&got){
+                last=false;
+            }else if(!last){
+                std::this_thread::yield();
+            }
         }
     } catch(...){
         e=std::current_exception();
@@ -314,6 +314,15 @@ linker_binary_override_cpp(JSON::str_opt(tg,"linker_binary_override_cpp")),
 linker_binary_override_c_cpp(JSON::str_opt(tg,"linker_binary_override_c_cpp")),
 linker_binary_override_other(JSON::str_opt(tg,"linker_binary_override_other")),
 linker_binary_override_all(JSON::str_opt(tg,"linker_binary_override_all")),
+linker_ar_incremental(JSON::bool_opt(tg,"linker_ar_incremental")),
+linker_ar_thin(JSON::bool_opt(tg,"linker_ar_thin")),
+linker_backend(JSON::str_opt(tg,"linker_backend")),
+split_dwarf(JSON::bool_opt(tg,"split_dwarf")),
+split_dwarf_dwp(JSON::bool_opt(tg,"split_dwarf_dwp")),
+lto(JSON::str_opt(tg,"lto")),
+generic_dep_flags(JSON::strlist_opt(tg,"generic_dep_flags")),
+generic_dep_format(JSON::str_opt(tg,"generic_dep_format")),
+cpp_modules(JSON::bool_opt(tg,"cpp_modules")),
 include_only(JSON::bool_opt(tg,"include_only",false)) {
     static const char * valid_keys[]{
         "sources",
@@ -350,11 +359,35 @@ include_only(JSON::bool_opt(tg,"include_only",false)) {
         "linker_binary_override_c_cpp",
         "linker_binary_override_other",
         "linker_binary_override_all",
+        "linker_ar_incremental",
+        "linker_ar_thin",
+        "linker_backend",
+        "split_dwarf",
+        "split_dwarf_dwp",
+        "lto",
+        "generic_dep_flags",
+        "generic_dep_format",
+        "cpp_modules",
         "include_only",
     };
     for(auto &e:Util::filter_exclude(Util::keys(tg),Util::CArrayIteratorAdaptor(valid_keys))){
         warnings_out.push_back("Ignored Unknown Element "+Util::quote_str_single(e));
     }
+    static const std::vector<std::string> lto_values{
+        "off",
+        "full",
+        "thin",
+    };
+    if(lto&&!Util::contains(lto_values,*lto)){
+        throw JSON::JSON_Exception("Invalid value "+Util::quote_str_single(*lto)+" for 'lto', must be one of { "+Util::join(Util::map(lto_values,&Util::quote_str_single),", ")+" }");
+    }
+    static const std::vector<std::string> generic_dep_format_values{
+        "make",
+        "list",
+    };
+    if(generic_dep_format&&!Util::contains(generic_dep_format_values,*generic_dep_format)){
+        throw JSON::JSON_Exception("Invalid value "+Util::quote_str_single(*generic_dep_format)+" for 'generic_dep_format', must be one of { "+Util::join(Util::map(generic_dep_format_values,&Util::quote_str_single),", ")+" }");
+    }
 }
 
 Targets::target& Targets::target::operator+=(const target& other) {
@@ -392,53 +425,90 @@ Targets::target& Targets::target::operator+=(const target& other) {
     if(!linker_binary_override_c_cpp&&other.linker_binary_override_c_cpp)linker_binary_override_c_cpp=*other.linker_binary_override_c_cpp;
     if(!linker_binary_override_other&&other.linker_binary_override_other)linker_binary_override_other=*other.linker_binary_override_other;
     if(!linker_binary_override_all&&other.linker_binary_override_all)linker_binary_override_all=*other.linker_binary_override_all;
+    if(!linker_ar_incremental&&other.linker_ar_incremental)linker_ar_incremental=*other.linker_ar_incremental;
+    if(!linker_ar_thin&&other.linker_ar_thin)linker_ar_thin=*other.linker_ar_thin;
+    if(!linker_backend&&other.linker_backend)linker_backend=*other.linker_backend;
+    if(!split_dwarf&&other.split_dwarf)split_dwarf=*other.split_dwarf;
+    if(!split_dwarf_dwp&&other.split_dwarf_dwp)split_dwarf_dwp=*other.split_dwarf_dwp;
+    if(!lto&&other.lto)lto=*other.lto;
+    if(generic_dep_flags.empty())generic_dep_flags=other.generic_dep_flags;
+    if(!generic_dep_format&&other.generic_dep_format)generic_dep_format=*other.generic_dep_format;
+    if(!cpp_modules&&other.cpp_modules)cpp_modules=*other.cpp_modules;
     return *this;
 }
 
-void Targets::process_includes(std::vector<std::string> &warnings_out){
-    std::vector<std::string> pending;
-    std::vector<std::string> include_only;
-    for(auto &t:targets){
-        if(!t.second.includes.empty()){
-            pending.push_back(t.first);
-        }
-        if(t.second.include_only){
-            include_only.push_back(t.first);
-        }
+const Targets::target * Targets::load_target(const std::string &name,std::vector<std::string> &loading,std::vector<std::string> &failed_out,std::vector<std::string> &warnings_out){
+    if(auto it=loaded.find(name);it!=loaded.end()){
+        return &it->second;
     }
-    size_t processed;
-    do {
-        processed=0;
-        for(const std::string &t:pending){
-            if(auto it=targets.find(t);it!=targets.end()){
-                target &tt=it->second;
-                for(const std::string &i:tt.includes){
-                    if(auto it2=targets.find(i);it2!=targets.end()){
-                        target &ii=it2->second;
-                        if(ii.includes.empty()){
-                            tt+=ii;
-                            tt.includes.erase(std::remove(tt.includes.begin(),tt.includes.end(),i),tt.includes.end());
-                            processed++;
-                        }
-                    }
-                }
+    auto def=definitions.find(name);
+    if(def==definitions.end()||failed.contains(name)||Util::contains(loading,name)){
+        return nullptr;
+    }
+    std::vector<std::string> target_warnings;
+    std::optional<target> t;
+    try {
+        t.emplace(*def->second,name,target_warnings);
+    } catch(JSON::JSON_Exception &e) {
+        throw JSON::JSON_Exception("In Target "+Util::quote_str_single(name)+": "+e.msg_top);
+    }
+    Util::extract_warnings(std::move(Util::inplace_map(target_warnings,[&name](const std::string &s)->std::string{return "In Target "+Util::quote_str_single(name)+": "+s;})),warnings_out);
+    //every include is complete before it's merged, so each target is merged once, in the order it's listed
+    std::vector<std::string> includes;
+    std::swap(includes,t->includes);
+    loading.push_back(name);
+    std::optional<std::string> error;
+    for(const std::string &i:includes){
+        if(const target * ii=load_target(i,loading,failed_out,warnings_out)){
+            *t+=*ii;
+        }else if(!error){
+            if(!definitions.contains(i)){
+                error="includes unknown target "+Util::quote_str_single(i);
+            }else if(auto it=failed.find(i);it!=failed.end()){
+                error="includes "+Util::quote_str_single(i)+", which "+it->second;
+            }else{
+                error="includes itself through "+Util::quote_str_single(i);
             }
         }
-        pending.erase(std::remove_if(pending.begin(),pending.end(), [this](const std::string &t)-> bool {
-            return targets.at(t).includes.empty();
-        }), pending.end());
-    } while(processed!=0);
-    if(pending.size()>0){
-        for(auto &t:pending){
-            targets.erase(t);
+    }
+    loading.pop_back();
+    if(error){
+        failed.insert({name,*error});
+        failed_out.push_back(name);
+        return nullptr;
+    }
+    return &loaded.emplace(name,std::move(*t)).first->second;
+}
+
+void Targets::load(const std::vector<std::string> &target_names,std::vector<std::string> &warnings_out){
+    std::vector<std::string> loading;
+    std::vector<std::string> failed_now;
+    for(const std::string &t:target_names){
+        if(definitions.contains(t)){
+            load_target(t,loading,failed_now,warnings_out);
         }
-        warnings_out.emplace_back("Failed to process includes for "+std::string(pending.size()==1?"target ":"targets: ")+Util::join(Util::map(pending,&Util::quote_str_single),", "));
     }
-    for(auto &t:include_only){
-        targets.erase(t);
+    if(failed_now.size()>0){
+        names.erase(std::remove_if(names.begin(),names.end(),[this](const std::string &t){return failed.contains(t);}),names.end());
+        warnings_out.emplace_back("Failed to process includes for "+std::string(failed_now.size()==1?"target ":"targets: ")+Util::join(Util::map(failed_now,&Util::quote_str_single),", "));
     }
 }
 
+bool Targets::contains(const std::string &name) const {
+    return Util::contains(names,name);
+}
+
+const Targets::target& Targets::at(const std::string &name) const {
+    if(auto it=failed.find(name);it!=failed.end()){
+        throw std::runtime_error("Failed to process includes, target "+Util::quote_str_single(name)+" "+it->second);
+    }
+    const target &t=loaded.at(name);
+    if(t.include_only){
+        throw std::out_of_range(name);
+    }
+    return t;
+}
+
 const char * target_group_valid_keys [] {
     "target_group",
 };
@@ -456,16 +526,18 @@ Targets::Targets(const JSON::object_t &targets_obj,std::vector<std::string> &war
             }
             target_groups.insert({t.first,JSON::strlist_nonopt(tobj,"target_group")});
         }else{
-            targets.insert({t.first,{tobj,t.first,target_warnings}});
+            definitions.insert({t.first,&tobj});
+            if(!JSON::bool_opt(tobj,"include_only",false)){
+                names.push_back(t.first);
+            }
         }
         Util::extract_warnings(std::move(Util::inplace_map(target_warnings,[&t,tg](const std::string &s)->std::string{return (tg?"In Target group ":"In Target ")+Util::quote_str_single(t.first)+": "+s;})),warnings_out);
     } catch(JSON::JSON_Exception &e) {
         throw JSON::JSON_Exception((tg?"In Target group ":"In Target ")+Util::quote_str_single(t.first)+": "+e.msg_top);
     }
-    process_includes(warnings_out);
     for(auto group:target_groups){
         group.second.erase(std::remove_if(group.second.begin(),group.second.end(),[this,&group,&warnings_out](const std::string &t){
-            if(!targets.contains(t)&&!target_groups.contains(t)){
+            if(!contains(t)&&!target_groups.contains(t)){
                 warnings_out.push_back("Ignored Unknown Target "+Util::quote_str_single(t)+" In Target group "+Util::quote_str_single(group.first));
                 return true;
             }else{
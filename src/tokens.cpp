@@ -0,0 +1,184 @@
+#include "tokens.h"
+#include "util.h"
+
+#include <array>
+#include <cstring>
+#include <cstdint>
+
+namespace Tokens {
+    
+    syntax syntax_of(const std::filesystem::path &file){
+        const std::string ext=file.extension().string();
+        for(const char * c_ext:{".c",".cc",".cpp",".cxx",".c++",".C",".h",".hh",".hpp",".hxx",".h++",".H",".inl",".ipp",".tpp",".tcc",".ixx",".cppm",".mpp",".m",".mm"}){
+            if(ext==c_ext)return SYNTAX_C;
+        }
+        if(ext==".s"||ext==".S"||ext==".sx")return SYNTAX_GAS;
+        return SYNTAX_RAW;
+    }
+    
+    namespace {
+        using char_table=std::array<bool,256>;
+        
+        constexpr char_table make_table(const char * special){
+            char_table table{};
+            for(const char * c=" \t\r\v\f\n";*c;c++)table[uint8_t(*c)]=true;
+            for(const char * c=special;*c;c++)table[uint8_t(*c)]=true;
+            return table;
+        }
+        
+        // bytes that may start a comment, literal or whitespace, everything else is copied over in bulk
+        constexpr char_table special_c=make_table("/\"'");
+        constexpr char_table special_gas=make_table("/\"'");
+        constexpr char_table special_nasm=make_table("\"'`;");
+        
+        bool is_ident(char c){
+            return (c>='a'&&c<='z')||(c>='A'&&c<='Z')||(c>='0'&&c<='9')||c=='_';
+        }
+        
+        // the identifier or number in 'data' that ends right before 'p'
+        std::string_view word_before(std::string_view data,const char * p,bool number){
+            const char * start=p;
+            while(start>data.data()&&(is_ident(start[-1])||(number&&(start[-1]=='\''||start[-1]=='.'))))start--;
+            return std::string_view(start,p-start);
+        }
+        
+        // end of the line comment starting at 'p', before its newline, following backslash-newlines
+        const char * line_comment_end(const char * p,const char * end,bool continuations){
+            while(const char * nl=static_cast<const char*>(memchr(p,'\n',end-p))){
+                const char * last=nl;
+                if(last>p&&last[-1]=='\r')last--;
+                if(!continuations||last==p||last[-1]!='\\')return nl;
+                p=nl+1;
+            }
+            return end;
+        }
+        
+        // end of the quoted literal starting at 'p', past its closing quote, or before the newline that ends it unterminated
+        const char * literal_end(const char * p,const char * end,bool escapes){
+            const char quote=*p++;
+            while(p<end){
+                if(*p==quote)return p+1;
+                if(*p=='\n')return p;
+                if(escapes&&*p=='\\'&&p+1<end)p++;
+                p++;
+            }
+            return end;
+        }
+    }
+    
+    std::string normalize(std::string_view data,syntax syn){
+        if(syn==SYNTAX_RAW)return std::string(data);
+        const char_table &special=syn==SYNTAX_C?special_c:(syn==SYNTAX_GAS?special_gas:special_nasm);
+        
+        std::string out;
+        out.reserve(data.size());
+        char pending=0; // whitespace since the last token, ' ' or '\n'
+        auto emit=[&](const char * from,const char * to){
+            if(pending&&!out.empty())out+=pending;
+            pending=0;
+            out.append(from,to);
+        };
+        auto space=[&](bool newline){
+            if(newline)pending='\n';
+            else if(!pending)pending=' ';
+        };
+        
+        const char * p=data.data();
+        const char * const end=p+data.size();
+        while(p<end){
+            const char * run=p;
+            while(run<end&&!special[uint8_t(*run)])run++;
+            if(run>p){
+                emit(p,run);
+                p=run;
+                continue;
+            }
+            switch(*p){
+            case '\n':
+                space(true);
+                p++;
+                break;
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\v':
+            case '\f':
+                space(false);
+                p++;
+                break;
+            case '/':
+                if(p+1<end&&p[1]=='*'){
+                    size_t close=data.find("*/",(p+2)-data.data());
+                    p=close==std::string_view::npos?end:data.data()+close+2;
+                    space(false);
+                }else if(syn==SYNTAX_C&&p+1<end&&p[1]=='/'){
+                    p=line_comment_end(p+2,end,true);
+                    space(false);
+                }else{
+                    emit(p,p+1);
+                    p++;
+                }
+                break;
+            case ';': // nasm only
+                p=line_comment_end(p+1,end,false);
+                space(false);
+                break;
+            case '\'':
+                if(syn==SYNTAX_GAS){ // character constant, no closing quote
+                    const char * e=std::min(end,p+((p+1<end&&p[1]=='\\')?3:2));
+                    emit(p,e);
+                    p=e;
+                    break;
+                }
+                if(syn==SYNTAX_C&&p>data.data()&&is_ident(p[-1])){
+                    std::string_view word=word_before(data,p,true);
+                    if(word[0]>='0'&&word[0]<='9'){ // digit separator
+                        emit(p,p+1);
+                        p++;
+                        break;
+                    }
+                }
+                [[fallthrough]];
+            case '`': // nasm only
+                {
+                    const char * e=literal_end(p,end,syn!=SYNTAX_NASM||*p=='`');
+                    emit(p,e);
+                    p=e;
+                }
+                break;
+            case '"':
+                if(syn==SYNTAX_C&&p>data.data()&&p[-1]=='R'){
+                    std::string_view prefix=word_before(data,p,false);
+                    if(prefix=="R"||prefix=="u8R"||prefix=="uR"||prefix=="UR"||prefix=="LR"){
+                        // raw string, R"delim( ... )delim"
+                        std::string_view rest(p+1,end-(p+1));
+                        size_t open=rest.find('(');
+                        if(open!=std::string_view::npos&&open<=16){
+                            size_t close=rest.find(")"+std::string(rest.substr(0,open))+"\"",open+1);
+                            const char * e=close==std::string_view::npos?end:p+1+close+open+2;
+                            emit(p,e);
+                            p=e;
+                            break;
+                        }
+                    }
+                }
+                {
+                    const char * e=literal_end(p,end,syn!=SYNTAX_NASM);
+                    emit(p,e);
+                    p=e;
+                }
+                break;
+            default:
+                emit(p,p+1);
+                p++;
+                break;
+            }
+        }
+        return out;
+    }
+    
+    std::string hash(const std::string &file,syntax syn){
+        return Util::sha256(normalize(Util::readfile(file,true),syn));
+    }
+
+}
@@ -0,0 +1,122 @@
+#include "toolchain.h"
+#include "util.h"
+#include "run.h"
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <cstring>
+
+// "RBuild toolchains 1\n" then, for every binary, its path, realpath, write time, size and version, each followed by a NUL
+
+static const char * toolchain_cache_header="RBuild toolchains 1\n";
+
+namespace Toolchain {
+    
+    std::filesystem::path cache_file;
+    
+    std::string fingerprint::id() const {
+        return Util::sha256(realpath+"\n"+std::to_string(write_time)+"\n"+std::to_string(size)+"\n"+version);
+    }
+    
+    namespace {
+        std::mutex mutex;
+        bool loaded=false;
+        bool changed=false;
+        std::map<std::string,fingerprint> fingerprints; // by path
+        std::set<std::string> checked; // paths checked against the disk in this run, their fingerprints don't change anymore
+        std::set<std::string> probing; // paths being checked by another thread
+        std::condition_variable probed;
+        
+        void load(){
+            loaded=true;
+            if(cache_file.empty()||!std::filesystem::exists(cache_file))return;
+            try{
+                const std::string data=Util::readfile(cache_file.string(),true);
+                if(!data.starts_with(toolchain_cache_header))return;
+                std::vector<std::string> fields;
+                for(size_t pos=strlen(toolchain_cache_header),end;(end=data.find('\0',pos))!=std::string::npos;pos=end+1){
+                    fields.push_back(data.substr(pos,end-pos));
+                }
+                for(size_t i=0;i+5<=fields.size();i+=5){
+                    fingerprints.insert({fields[i],{
+                        .path=fields[i],
+                        .realpath=fields[i+1],
+                        .write_time=std::stoll(fields[i+2]),
+                        .size=std::stoull(fields[i+3]),
+                        .version=fields[i+4],
+                    }});
+                }
+            }catch(std::exception &e){
+                fingerprints.clear(); // unreadable, start over
+            }
+        }
+        
+        fingerprint make_fingerprint(const std::string &binary){
+            fingerprint fp{.path=binary};
+            std::error_code ec;
+            std::filesystem::path real=std::filesystem::canonical(binary,ec);
+            if(ec)return fp;
+            auto time=std::filesystem::last_write_time(real,ec);
+            if(ec)return fp;
+            auto size=std::filesystem::file_size(real,ec);
+            if(ec)return fp;
+            fp.realpath=real.string();
+            fp.write_time=time.time_since_epoch().count();
+            fp.size=size;
+            return fp;
+        }
+    }
+    
+    const fingerprint& get(const std::string &binary){
+        std::unique_lock<std::mutex> lock(mutex);
+        if(!loaded)load();
+        probed.wait(lock,[&binary](){return !probing.contains(binary);});
+        if(checked.contains(binary))return fingerprints.at(binary);
+        std::optional<fingerprint> cached;
+        if(auto it=fingerprints.find(binary);it!=fingerprints.end())cached=it->second;
+        probing.insert(binary);
+        lock.unlock();
+        
+        //stat and run the binary without holding the lock, other binaries can be fingerprinted meanwhile
+        fingerprint fp=make_fingerprint(binary);
+        const bool unchanged=cached&&!fp.realpath.empty()&&cached->realpath==fp.realpath&&cached->write_time==fp.write_time&&cached->size==fp.size;
+        if(!unchanged){
+            try{
+                Util::redirect_data rd;
+                Util::run(binary,{"--version"},nullptr,true,&rd);
+                rd.stop();
+                fp.version=rd.s_stdout;
+            }catch(std::exception &e){
+                // not runnable, fingerprinted by its path alone
+            }
+        }
+        
+        lock.lock();
+        probing.erase(binary);
+        checked.insert(binary);
+        probed.notify_all();
+        if(unchanged)return fingerprints.at(binary);
+        if(!fp.realpath.empty())changed=true; // binaries that weren't found aren't worth keeping
+        return fingerprints.insert_or_assign(binary,std::move(fp)).first->second;
+    }
+    
+    void save(){
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!changed||cache_file.empty())return;
+        std::string data=toolchain_cache_header;
+        for(const auto &[binary,fp]:fingerprints){
+            if(fp.realpath.empty())continue;
+            for(const std::string &field:{fp.path,fp.realpath,std::to_string(fp.write_time),std::to_string(fp.size),fp.version}){
+                data+=field;
+                data+='\0';
+            }
+        }
+        std::filesystem::create_directories(std::filesystem::path(cache_file).remove_filename());
+        Util::writefile(cache_file.string(),data,true);
+        changed=false;
+    }
+    
+}
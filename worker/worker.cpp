@@ -0,0 +1,24 @@
+#include "remote.h"
+#include "args.h"
+#include "util.h"
+
+#include <iostream>
+#include <cstdlib>
+
+// runs compile requests from RBuild's -workers, see README.md
+// usage: rbuild-worker [-listen=127.0.0.1:7711|unix:/path] [-num_jobs=auto] [-allow=gcc,g++,clang,clang++]
+
+int main(int argc,char ** argv) try {
+    Args::init(argc,argv);
+    
+    std::optional<int> njopt=Args::namedIntArgOrMatchStr("num_jobs",0,"auto",false);
+    const int max_jobs=(njopt&&*njopt>0)?*njopt:Util::numCPUs();
+    
+    // programs clients may run, by file name (resolved through the worker's PATH) or full path
+    const std::vector<std::string> allowed=Util::split(Args::namedArgOr("allow","gcc,g++,clang,clang++"),',');
+    
+    Remote::serve(Args::namedArgOr("listen","127.0.0.1:7711"),max_jobs,allowed);
+} catch(std::exception &e) {
+    std::cerr<<"Unexpected Exception: "<<e.what()<<"\n";
+    return EXIT_FAILURE;
+}